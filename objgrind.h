@@ -70,6 +70,31 @@ typedef
 
       VG_USERREQ__CHECK_UNWRITABLE,
 
+      VG_USERREQ__COMPACT_SHADOW,
+
+      VG_USERREQ__ADD_REFCHECK_FIELDS,
+      VG_USERREQ__REMOVE_REFCHECK_FIELDS,
+      VG_USERREQ__ADD_REFCHECK_FIELD_ARRAY,
+      VG_USERREQ__REMOVE_REFCHECK_FIELD_ARRAY,
+
+      VG_USERREQ__REGISTER_OBJECT_LAYOUT,
+      VG_USERREQ__MAKE_OBJECT,
+
+      VG_USERREQ__PRINT_STATS,
+
+      VG_USERREQ__START_CHECKING,
+      VG_USERREQ__STOP_CHECKING,
+      VG_USERREQ__ENABLE_THREAD_CHECKING,
+      VG_USERREQ__DISABLE_THREAD_CHECKING,
+
+      VG_USERREQ__DUMP_SHADOW,
+
+      VG_USERREQ__COUNT_STATE,
+      VG_USERREQ__FIND_STATE,
+      VG_USERREQ__GET_STATE_BITMAP,
+
+      VG_USERREQ__CHECK_DANGLING_REFS,
+
    } Vg_ObjgrindClientRequest;
 
 #define VALGRIND_MAKE_NOCHECK(_qzz_addr,_qzz_len)               \
@@ -87,6 +112,9 @@ typedef
                             VG_USERREQ__MAKE_UNREFERABLE,       \
                             (_qzz_addr), (_qzz_len), 0, 0, 0)
 
+/* A refcheck field is the host word at _qzz_addr.  It needn't be word
+   aligned, except with --granularity=word, where the field is the
+   word containing _qzz_addr. */
 #define VALGRIND_ADD_REFCHECK_FIELD(_qzz_addr)                  \
     VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
                             VG_USERREQ__ADD_REFCHECK_FIELD,     \
@@ -102,4 +130,122 @@ typedef
                             VG_USERREQ__CHECK_UNWRITABLE,       \
                             (_qzz_addr), 0, 0, 0, 0)
 
+/* Fields at _qzz_addr, _qzz_addr + _qzz_stride, ... below
+   _qzz_addr + _qzz_len.  Returns the number of fields changed. */
+#define VALGRIND_ADD_REFCHECK_FIELDS(_qzz_addr,_qzz_len,_qzz_stride) \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__ADD_REFCHECK_FIELDS,    \
+                            (_qzz_addr), (_qzz_len), (_qzz_stride), 0, 0)
+
+#define VALGRIND_REMOVE_REFCHECK_FIELDS(_qzz_addr,_qzz_len,_qzz_stride) \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__REMOVE_REFCHECK_FIELDS, \
+                            (_qzz_addr), (_qzz_len), (_qzz_stride), 0, 0)
+
+/* _qzz_fields points at an array of _qzz_n field addresses.  Returns
+   the number of fields changed. */
+#define VALGRIND_ADD_REFCHECK_FIELD_ARRAY(_qzz_fields,_qzz_n)   \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__ADD_REFCHECK_FIELD_ARRAY, \
+                            (_qzz_fields), (_qzz_n), 0, 0, 0)
+
+#define VALGRIND_REMOVE_REFCHECK_FIELD_ARRAY(_qzz_fields,_qzz_n) \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__REMOVE_REFCHECK_FIELD_ARRAY, \
+                            (_qzz_fields), (_qzz_n), 0, 0, 0)
+
+/* Register an object shape of _qzz_size bytes.  _qzz_refmap and
+   _qzz_unwritablemap are bitmaps (bit i of byte i/8) with one bit per
+   machine word of the object, marking reference fields and unwritable
+   words; either may be NULL.  Returns a type id, or 0 on failure. */
+#define VALGRIND_REGISTER_OBJECT_LAYOUT(_qzz_size,_qzz_refmap,_qzz_unwritablemap) \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__REGISTER_OBJECT_LAYOUT, \
+                            (_qzz_size), (_qzz_refmap),         \
+                            (_qzz_unwritablemap), 0, 0)
+
+/* Set the state of the object at _qzz_addr from its registered
+   layout.  Returns 1 on success. */
+#define VALGRIND_MAKE_OBJECT(_qzz_addr,_qzz_type_id)            \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__MAKE_OBJECT,            \
+                            (_qzz_addr), (_qzz_type_id), 0, 0, 0)
+
+/* Print the statistics --stats=yes prints at exit. */
+#define VALGRIND_PRINT_STATS()                                  \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__PRINT_STATS,    \
+                                    0, 0, 0, 0, 0)
+
+/* Turn checking on or off for the whole program.  Off, the program
+   runs nearly at full speed; each switch discards all translations,
+   so don't do it often.  See also --check-at-start. */
+#define VALGRIND_START_CHECKING()                               \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__START_CHECKING, \
+                                    0, 0, 0, 0, 0)
+
+#define VALGRIND_STOP_CHECKING()                                \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__STOP_CHECKING,  \
+                                    0, 0, 0, 0, 0)
+
+/* Turn checking on or off for the calling thread only, e.g. for a
+   collector thread which legitimately writes unwritable objects. */
+#define VALGRIND_ENABLE_THREAD_CHECKING()                       \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__ENABLE_THREAD_CHECKING, \
+                                    0, 0, 0, 0, 0)
+
+#define VALGRIND_DISABLE_THREAD_CHECKING()                      \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DISABLE_THREAD_CHECKING, \
+                                    0, 0, 0, 0, 0)
+
+/* Write the whole shadow state to the file _qzz_file, for og_print.
+   Returns 1 if it was written. */
+#define VALGRIND_DUMP_SHADOW(_qzz_file)                         \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__DUMP_SHADOW,            \
+                            (_qzz_file), 0, 0, 0, 0)
+
+/* States for the range queries below. */
+#define VALGRIND_STATE_NOCHECK      0
+#define VALGRIND_STATE_UNWRITABLE   1
+#define VALGRIND_STATE_UNREFERABLE  2
+#define VALGRIND_STATE_REFCHECK     3
+
+/* Returns the number of bytes of [_qzz_addr, _qzz_addr + _qzz_len)
+   in _qzz_state. */
+#define VALGRIND_COUNT_STATE(_qzz_addr,_qzz_len,_qzz_state)     \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__COUNT_STATE,            \
+                            (_qzz_addr), (_qzz_len), (_qzz_state), 0, 0)
+
+/* Returns the offset from _qzz_addr of the first byte of the range in
+   _qzz_state, or -1 if there is none. */
+#define VALGRIND_FIND_STATE(_qzz_addr,_qzz_len,_qzz_state)      \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(-1 /* default return */,    \
+                            VG_USERREQ__FIND_STATE,             \
+                            (_qzz_addr), (_qzz_len), (_qzz_state), 0, 0)
+
+/* Write the state of each machine word of the range to _qzz_bitmap,
+   2 bits per word and four words per byte, the first in the low bits.
+   A word has the state of its first byte.  _qzz_addr must be word
+   aligned and _qzz_bitmap at least (words + 3) / 4 bytes long.
+   Returns the number of words written, 0 on failure. */
+#define VALGRIND_GET_STATE_BITMAP(_qzz_addr,_qzz_len,_qzz_bitmap) \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__GET_STATE_BITMAP,       \
+                            (_qzz_addr), (_qzz_len), (_qzz_bitmap), 0, 0)
+
+/* Read every REFCHECK field, aligned or not, and report a
+   DanglingReferenceError for each one holding an UNREFERABLE value,
+   e.g. at the end of a GC.  Returns the number found. */
+#define VALGRIND_CHECK_DANGLING_REFS()                          \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__CHECK_DANGLING_REFS,    \
+                            0, 0, 0, 0, 0)
+
+/* Returns the number of bytes of shadow memory reclaimed. */
+#define VALGRIND_COMPACT_SHADOW()                               \
+    VALGRIND_DO_CLIENT_REQUEST_EXPR(0 /* default return */,     \
+                            VG_USERREQ__COMPACT_SHADOW,         \
+                            0, 0, 0, 0, 0)
+
 #endif
@@ -24,6 +24,8 @@ static Bool og_compare_error_contexts(VgRes res, Error* e1, Error* e2)
     switch (VG_(get_error_kind)(e1)) {
     case UnwritableErr:
     case UnreferableErr:
+    case UnreferableLoadErr:
+    case DanglingRefErr:
         return (VG_(get_error_address)(e1) == VG_(get_error_address)(e2) ? True : False);
     default: 
         VG_(printf)("Error:\n  unknown error code %d\n",
@@ -57,8 +59,55 @@ static void og_tool_error_before_pp (Error* err) {
     /* Noop */
 }
 
+/* Indexed by the A_BITS2_* states in og_main.c. */
+const HChar* const OG_(state_names)[4] = {
+   "nocheck", "unwritable", "unreferable", "refcheck"
+};
+
+static void pp_data_symbol ( Addr a )
+{
+    HChar    name[128];
+    PtrdiffT off;
+
+    if (!VG_(get_datasym_and_offset)(a, name, sizeof(name), &off))
+        return;
+    emit(VG_(clo_xml)
+         ? "  <auxwhat>Address 0x%lx is %ld bytes inside data symbol "
+           "\"%s\"</auxwhat>\n"
+         : " Address 0x%lx is %ld bytes inside data symbol \"%s\"\n",
+         a, (long)off, name);
+}
+
+/* The value of an UnwritableErr store is only shown with -v. */
+static void pp_extra ( const OgErrorExtra* extra, Bool show_value )
+{
+    const Bool xml = VG_(clo_xml);
+
+    emit(xml ? "  <auxwhat>Field 0x%lx (%s) in 64KB region 0x%lx</auxwhat>\n"
+             : " Field 0x%lx (%s) in 64KB region 0x%lx\n",
+         extra->field, OG_(state_names)[extra->field_state & 3],
+         extra->field & ~(Addr)0xffff);
+    pp_data_symbol(extra->field);
+    if (show_value && extra->has_value) {
+        emit(xml ? "  <auxwhat>Value 0x%lx (%s)</auxwhat>\n"
+                 : " Value 0x%lx (%s)\n",
+             extra->value, OG_(state_names)[extra->value_state & 3]);
+        pp_data_symbol(extra->value);
+    }
+    if (extra->origin) {
+        emit(xml ? "  <auxwhat>Address 0x%lx is %lu bytes inside a %lu-byte "
+                   "range made unreferable</auxwhat>\n"
+                 : " Address 0x%lx is %lu bytes inside a %lu-byte "
+                   "range made unreferable\n",
+             extra->value, extra->value - extra->origin_start,
+             extra->origin_len);
+        VG_(pp_ExeContext)(extra->origin);
+    }
+}
+
 static void og_tool_error_pp (Error* err) {
     const Bool xml  = VG_(clo_xml); /* a shorthand */
+    const OgErrorExtra* extra = VG_(get_error_extra)(err);
 
     switch (VG_(get_error_kind)(err)) {
     case UnwritableErr:
@@ -70,6 +119,7 @@ static void og_tool_error_pp (Error* err) {
             emit(STR_UnwritableError);
             VG_(pp_ExeContext)( VG_(get_error_where)(err) );
         }
+        pp_extra(extra, VG_(clo_verbosity) > 1);
         break;
     case UnreferableErr:
         if (xml) {
@@ -80,6 +130,29 @@ static void og_tool_error_pp (Error* err) {
             emit(STR_UnreferableError);
             VG_(pp_ExeContext)( VG_(get_error_where)(err) );
         }
+        pp_extra(extra, True);
+        break;
+    case UnreferableLoadErr:
+        if (xml) {
+            emit("<kind>%s</kind>", STR_UnreferableLoadError);
+            VG_(pp_ExeContext)( VG_(get_error_where)(err) );
+        }
+        else {
+            emit(STR_UnreferableLoadError);
+            VG_(pp_ExeContext)( VG_(get_error_where)(err) );
+        }
+        pp_extra(extra, True);
+        break;
+    case DanglingRefErr:
+        if (xml) {
+            emit("<kind>%s</kind>", STR_DanglingRefError);
+            VG_(pp_ExeContext)( VG_(get_error_where)(err) );
+        }
+        else {
+            emit(STR_DanglingRefError);
+            VG_(pp_ExeContext)( VG_(get_error_where)(err) );
+        }
+        pp_extra(extra, True);
         break;
     default:
         VG_(printf)("Error:\n  unknown Objgrind error code %d\n",
@@ -90,8 +163,9 @@ static void og_tool_error_pp (Error* err) {
 
 static UInt og_tool_error_update_extra(Error* e)
 {
-    /* TODO: add extra error for each kind */
-    return 0;
+    /* The extra is complete when recorded; just have the core copy
+       it. */
+    return sizeof(OgErrorExtra);
 }
 
 
@@ -104,6 +178,10 @@ static Bool og_is_recognized_suppression(const HChar* const name,
       skind = UnwritableErr;
    else if (VG_(strcmp)(name, STR_UnreferableError) == 0)
       skind = UnreferableErr;
+   else if (VG_(strcmp)(name, STR_UnreferableLoadError) == 0)
+      skind = UnreferableLoadErr;
+   else if (VG_(strcmp)(name, STR_DanglingRefError) == 0)
+      skind = DanglingRefErr;
    else
       return False;
 
@@ -127,8 +205,10 @@ static const HChar* og_get_error_name(Error* e)
 {
    switch (VG_(get_error_kind)(e))
    {
-   case UnwritableErr:  return VGAPPEND(STR_, UnwritableError);
-   case UnreferableErr: return VGAPPEND(STR_, UnreferableError);
+   case UnwritableErr:      return VGAPPEND(STR_, UnwritableError);
+   case UnreferableErr:     return VGAPPEND(STR_, UnreferableError);
+   case UnreferableLoadErr: return VGAPPEND(STR_, UnreferableLoadError);
+   case DanglingRefErr:     return VGAPPEND(STR_, DanglingRefError);
    default:
       tl_assert(0);
    }
@@ -143,6 +223,118 @@ Bool og_get_extra_suppression_info(Error* e,
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Aggregation of errors by code address                ---*/
+/*------------------------------------------------------------*/
+
+/* A buggy write barrier can hit a million distinct objects from the
+   same instruction.  Passing each of those to the core would make a
+   million error records, since errors with different addresses are
+   never merged, each with its own stack unwind.  So errors are first
+   counted per (kind, code address) here and only the first
+   OG_(clo_max_errors_per_site) from each site are recorded. */
+
+#define N_ERROR_KINDS  (DanglingRefErr + 1)
+#define N_SITE_SAMPLES 4
+
+typedef
+   struct _ErrorSite {
+      struct _ErrorSite* next;
+      UWord  key;                       // code address
+      ULong  count;                     // # errors seen here
+      Addr   samples[N_SITE_SAMPLES];   // the first few error addresses
+   }
+   ErrorSite;
+
+/* One table per error kind, created on first use. */
+static VgHashTable error_sites[N_ERROR_KINDS];
+
+static ULong n_errors_unreported = 0;
+
+void OG_(record_error)(OgErrorKind kind, Addr a, OgErrorExtra* extra)
+{
+   ThreadId   tid = VG_(get_running_tid)();
+   Addr       ip  = VG_(get_IP)(tid);
+   ErrorSite* site;
+
+   tl_assert(kind > 0 && kind < N_ERROR_KINDS);
+   if (error_sites[kind] == NULL)
+      error_sites[kind] = VG_(HT_construct)("og.error_sites");
+
+   site = VG_(HT_lookup)(error_sites[kind], ip);
+   if (site == NULL) {
+      site = VG_(calloc)("og.error_site", 1, sizeof(ErrorSite));
+      site->key = ip;
+      VG_(HT_add_node)(error_sites[kind], site);
+   }
+   if (site->count < N_SITE_SAMPLES)
+      site->samples[site->count] = a;
+   site->count++;
+
+   if (OG_(clo_max_errors_per_site) == 0
+       || site->count <= OG_(clo_max_errors_per_site))
+      VG_(maybe_record_error)(tid, kind, a, NULL, extra);
+   else
+      n_errors_unreported++;
+}
+
+/* Records an error at field 'a' without the per-site limit, for
+   errors found by scanning the heap: the code address is that of the
+   request, and it is the field that tells them apart. */
+void OG_(record_field_error)(OgErrorKind kind, Addr a, OgErrorExtra* extra)
+{
+   tl_assert(kind > 0 && kind < N_ERROR_KINDS);
+   VG_(maybe_record_error)(VG_(get_running_tid)(), kind, a, NULL, extra);
+}
+
+static Int cmp_sites_by_count ( const void* v1, const void* v2 )
+{
+   const ErrorSite* s1 = *(const ErrorSite* const*)v1;
+   const ErrorSite* s2 = *(const ErrorSite* const*)v2;
+   return s1->count < s2->count ? 1 : s1->count > s2->count ? -1 : 0;
+}
+
+static void print_error_sites_of_kind ( OgErrorKind kind, const HChar* name )
+{
+   ErrorSite** sites;
+   UInt        n_sites, i, j;
+   HChar       buf[256];
+
+   if (error_sites[kind] == NULL)
+      return;
+   sites = (ErrorSite**)VG_(HT_to_array)(error_sites[kind], &n_sites);
+   VG_(ssort)(sites, n_sites, sizeof(ErrorSite*), cmp_sites_by_count);
+   for (i = 0; i < n_sites; i++) {
+      if (sites[i]->count <= OG_(clo_max_errors_per_site))
+         continue;
+      VG_(umsg)("%12llu %s at %s\n",
+                sites[i]->count - OG_(clo_max_errors_per_site), name,
+                VG_(describe_IP)(sites[i]->key, buf, sizeof(buf)));
+      VG_(umsg)("             e.g.");
+      for (j = 0; j < N_SITE_SAMPLES && j < sites[i]->count; j++)
+         VG_(umsg)(" %#lx", sites[i]->samples[j]);
+      VG_(umsg)("\n");
+   }
+   VG_(free)(sites);
+}
+
+/* Called at exit.  Lists the sites whose errors were not all
+   recorded, most frequent first, with how many were dropped and the
+   addresses of the first few errors seen there. */
+void OG_(print_error_sites)(void)
+{
+   if (n_errors_unreported == 0 || VG_(clo_xml))
+      return;
+   VG_(umsg)("\n");
+   VG_(umsg)("%llu errors not shown (--max-errors-per-site=%u):\n",
+             n_errors_unreported, OG_(clo_max_errors_per_site));
+   print_error_sites_of_kind(UnwritableErr,      STR_UnwritableError);
+   print_error_sites_of_kind(UnreferableErr,     STR_UnreferableError);
+   print_error_sites_of_kind(UnreferableLoadErr, STR_UnreferableLoadError);
+   print_error_sites_of_kind(DanglingRefErr,     STR_DanglingRefError);
+}
+
+
 void OG_(register_error_handlers)(void)
 {
    VG_(needs_tool_errors)(og_compare_error_contexts,
@@ -3,6 +3,7 @@
 #define __OG_ERROR_H
 
 #include "pub_tool_basics.h"      // Addr
+#include "pub_tool_execontext.h"  // ExeContext
 
 #define OG_(str) VGAPPEND(vgOg_, str)
 
@@ -11,8 +12,40 @@ typedef enum {
    UnwritableErr = 1,
 #define STR_UnreferableError  "UnreferableError"
    UnreferableErr,
+#define STR_UnreferableLoadError  "UnreferableLoadError"
+   UnreferableLoadErr,
+#define STR_DanglingRefError  "DanglingReferenceError"
+   DanglingRefErr,
 } OgErrorKind;
 
+/* Recorded with each error.  Only raw values are kept; they are
+   described when the error is printed. */
+typedef
+   struct {
+      Addr  field;         // the store's destination
+      UWord value;         // the value stored, if has_value
+      Bool  has_value;
+      UChar field_state;   // A_BITS2_* state of field and of value
+      UChar value_state;
+      // Where the value was made unreferable, or NULL if that isn't
+      // known (see --track-unreferable-origins).
+      ExeContext* origin;
+      Addr        origin_start;
+      SizeT       origin_len;
+   }
+   OgErrorExtra;
+
 void OG_(register_error_handlers)(void);
 
+/* "nocheck", "unwritable", ..., indexed by A_BITS2_* state. */
+extern const HChar* const OG_(state_names)[4];
+
+/* Errors from one code address beyond this many are only counted, 0
+   means no limit.  (--max-errors-per-site) */
+extern UInt OG_(clo_max_errors_per_site);
+
+void OG_(record_error)(OgErrorKind kind, Addr a, OgErrorExtra* extra);
+void OG_(record_field_error)(OgErrorKind kind, Addr a, OgErrorExtra* extra);
+void OG_(print_error_sites)(void);
+
 #endif
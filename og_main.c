@@ -27,21 +27,29 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_aspacemgr.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_execontext.h"
 #include "pub_tool_gdbserver.h"
 #include "pub_tool_poolalloc.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
 #include "pub_tool_libcprint.h"
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_oset.h"
 #include "pub_tool_replacemalloc.h"
+#include "pub_tool_stacktrace.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_threadstate.h"
+#include "pub_tool_transtab.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_xarray.h"
 
 #include "objgrind.h"   /* for client requests */
 #include "og_error.h"
+#include "og_shadow_dump.h"
 
 
 /*------------------------------------------------------------*/
@@ -49,6 +57,10 @@
 /*    Some parts are edited. 2013/06/15                       */
 /*------------------------------------------------------------*/
 
+/* Set to 1 to do the range permission setting in word/secmap sized
+   steps rather than byte by byte. */
+#define PERF_FAST_SARP     1
+
 /* --------------- Basic configuration --------------- */
 
 /* Only change this.  N_PRIMARY_MAP *must* be a power of 2. */
@@ -60,9 +72,8 @@
 
 #else
 
-/* Just handle the first 64G fast and the rest via auxiliary
-   primaries.  If you change this, Objgrind will assert at startup.
-   See the definition of UNALIGNED_OR_HIGH for extensive comments. */
+/* Just handle the first 64G with a single lookup and the rest via
+   the radix tree. */
 #  define N_PRIMARY_BITS  20
 
 #endif
@@ -92,9 +103,14 @@
 #define A_BITS16_UNREFERABLE 0xaaaa   // 10_10_10_10b x 2
 #define A_BITS16_REFCHECK    0xffff   // 11_11_11_11b x 2
 
+/* With --granularity=byte each 2-bit state describes one byte; with
+   --granularity=word it describes one aligned machine word, and only
+   the first SM_CHUNKS >> og_gran_shift bytes of abits8 are used. */
+static UInt  og_gran_shift = 0;          /* log2 bytes per state */
+static SizeT sm_bytes      = 16384;      /* bytes of abits8 in use */
+
 #define SM_CHUNKS             16384
-#define SM_OFF(aaa)           (((aaa) & 0xffff) >> 2)
-#define SM_OFF_16(aaa)        (((aaa) & 0xffff) >> 3)
+#define SM_OFF(aaa)           ((((aaa) & 0xffff) >> og_gran_shift) >> 2)
 
 /* The number of entries in the primary map can be altered.  However
    we hardwire the assumption that each secondary map covers precisely
@@ -102,13 +118,9 @@
 #define SM_SIZE 65536            /* DO NOT CHANGE */
 #define SM_MASK (SM_SIZE-1)      /* DO NOT CHANGE */
 
-/* # searches initiated in auxmap_L1, and # base cmps required */
-static ULong n_auxmap_L1_searches  = 0;
-static ULong n_auxmap_L1_cmps      = 0;
-/* # of searches that missed in auxmap_L1 and therefore had to
-   be handed to auxmap_L2. And the number of nodes inserted. */
-static ULong n_auxmap_L2_searches  = 0;
-static ULong n_auxmap_L2_nodes     = 0;
+/* # radix tree nodes allocated at each level. */
+static ULong n_radix_L2_nodes      = 0;
+static ULong n_radix_L3_nodes      = 0;
 
 
 // Paranoia:  it's critical for performance that the requested inlining
@@ -131,9 +143,28 @@ typedef
 #define SM_DIST_NOCHECK   0
 #define SM_DIST_UNWRITABLE 1
 #define SM_DIST_UNREFERABLE 2
+/* Passed to set_address_range_perms for states with no distinguished
+   secmap (REFCHECK). */
+#define SM_DIST_NONE       ((UWord)-1)
 
 static SecMap sm_distinguished[3];
 
+/* # secmaps allocated and freed, and the high water mark. */
+static ULong n_issued_SMs   = 0;
+static ULong n_deissued_SMs = 0;
+static ULong max_SMs_in_use = 0;
+
+/* Once more than sm_compact_limit secmaps are in use, uniform ones
+   are handed back to the distinguished secmaps at the next safe
+   point (see compact_secmaps_if_pending). */
+#define SM_COMPACT_LIMIT_INIT 1024   /* 16MB of secmaps */
+static ULong sm_compact_limit   = SM_COMPACT_LIMIT_INIT;
+static Bool  sm_compact_pending = False;
+
+/* # compactions run, and # secmaps they freed. */
+static ULong n_sm_compactions   = 0;
+static ULong n_sm_reclaimed     = 0;
+
 static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
    return sm >= &sm_distinguished[0] && sm <= &sm_distinguished[2];
 }
@@ -145,14 +176,26 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
           || dist_sm == &sm_distinguished[1]
           || dist_sm == &sm_distinguished[2]);
 
-   new_sm = VG_(malloc)("og.scm.1", sizeof(SecMap));
+   new_sm = VG_(malloc)("og.scm.1", sm_bytes);
    if (new_sm == NULL)
       VG_(out_of_memory_NORETURN)( "objgrind:allocate new SecMap", 
-                                   sizeof(SecMap) );
-   VG_(memcpy)(new_sm, dist_sm, sizeof(SecMap));
+                                   sm_bytes );
+   VG_(memcpy)(new_sm, dist_sm, sm_bytes);
+   n_issued_SMs++;
+   if (n_issued_SMs - n_deissued_SMs > max_SMs_in_use)
+      max_SMs_in_use = n_issued_SMs - n_deissued_SMs;
+   if (n_issued_SMs - n_deissued_SMs > sm_compact_limit)
+      sm_compact_pending = True;
    return new_sm;
 }
 
+static void free_secmap ( SecMap* sm )
+{
+   tl_assert(!is_distinguished_sm(sm));
+   VG_(free)(sm);
+   n_deissued_SMs++;
+}
+
 /* --------------- Primary maps --------------- */
 
 /* The main primary map.  This covers some initial part of the address
@@ -162,234 +205,115 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
 static SecMap* primary_map[N_PRIMARY_MAP];
 
 
-/* An entry in the auxiliary primary map.  base must be a 64k-aligned
-   value, and sm points at the relevant secondary map.  As with the
-   main primary map, the secondary may be either a real secondary, or
-   one of the three distinguished secondaries.  DO NOT CHANGE THIS
-   LAYOUT: the first word has to be the key for OSet fast lookups.
-*/
+/* Secmaps above MAX_PRIMARY_ADDRESS are found through a three level
+   radix tree indexed by bits 63..48, 47..32 and 31..16 of the address.
+   Nodes are only allocated when a secmap under them is written.  Empty
+   subtrees point at the static radix_empty_* nodes rather than NULL,
+   so a lookup for reading is always three loads and never allocates,
+   and generated code can do the same lookup inline. */
+#define RADIX_BITS  16
+#define RADIX_SIZE  (1 << RADIX_BITS)
+#define RADIX_MASK  (RADIX_SIZE - 1)
+
 typedef
-   struct { 
-      Addr    base;
-      SecMap* sm;
+   struct {
+      SecMap* sm[RADIX_SIZE];
    }
-   AuxMapEnt;
+   RadixL3;
 
-/* Tunable parameter: How big is the L1 queue? */
-#define N_AUXMAP_L1 24
-
-/* Tunable parameter: How far along the L1 queue to insert
-   entries resulting from L2 lookups? */
-#define AUXMAP_L1_INSERT_IX 12
+typedef
+   struct {
+      RadixL3* l3[RADIX_SIZE];
+   }
+   RadixL2;
 
-static struct {
-          Addr       base;
-          AuxMapEnt* ent; // pointer to the matching auxmap_L2 node
-       } 
-       auxmap_L1[N_AUXMAP_L1];
+static RadixL2* radix_l1[RADIX_SIZE];
+static RadixL2  radix_empty_l2;     /* every entry is radix_empty_l3 */
+static RadixL3  radix_empty_l3;     /* every entry is NOCHECK */
 
-static OSet* auxmap_L2 = NULL;
+static INLINE UWord radix_ix1 ( Addr a ) {
+   return (UWord)(((ULong)a >> 48) & RADIX_MASK);
+}
+static INLINE UWord radix_ix2 ( Addr a ) {
+   return (UWord)(((ULong)a >> 32) & RADIX_MASK);
+}
+static INLINE UWord radix_ix3 ( Addr a ) {
+   return (UWord)(((ULong)a >> 16) & RADIX_MASK);
+}
 
-static void init_auxmap_L1_L2 ( void )
+static void init_radix ( void )
 {
-   Int i;
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      auxmap_L1[i].base = 0;
-      auxmap_L1[i].ent  = NULL;
-   }
-
-   tl_assert(0 == offsetof(AuxMapEnt,base));
-   tl_assert(sizeof(Addr) == sizeof(void*));
-   auxmap_L2 = VG_(OSetGen_Create)( /*keyOff*/  offsetof(AuxMapEnt,base),
-                                    /*fastCmp*/ NULL,
-                                    VG_(malloc), "mc.iaLL.1", VG_(free) );
-}
-
-/* Check representation invariants; if OK return NULL; else a
-   descriptive bit of text.  Also return the number of
-   non-distinguished secondary maps referred to from the auxiliary
-   primary maps. */
-
-static const HChar* check_auxmap_L1_L2_sanity ( Word* n_secmaps_found )
-{
-   Word i, j;
-   /* On a 32-bit platform, the L2 and L1 tables should
-      both remain empty forever.
-
-      On a 64-bit platform:
-      In the L2 table:
-       all .base & 0xFFFF == 0
-       all .base > MAX_PRIMARY_ADDRESS
-      In the L1 table:
-       all .base & 0xFFFF == 0
-       all (.base > MAX_PRIMARY_ADDRESS
-            .base & 0xFFFF == 0
-            and .ent points to an AuxMapEnt with the same .base)
-           or
-           (.base == 0 and .ent == NULL)
-   */
-   *n_secmaps_found = 0;
-   if (sizeof(void*) == 4) {
-      /* 32-bit platform */
-      if (VG_(OSetGen_Size)(auxmap_L2) != 0)
-         return "32-bit: auxmap_L2 is non-empty";
-      for (i = 0; i < N_AUXMAP_L1; i++) 
-        if (auxmap_L1[i].base != 0 || auxmap_L1[i].ent != NULL)
-      return "32-bit: auxmap_L1 is non-empty";
-   } else {
-      /* 64-bit platform */
-      UWord elems_seen = 0;
-      AuxMapEnt *elem, *res;
-      AuxMapEnt key;
-      /* L2 table */
-      VG_(OSetGen_ResetIter)(auxmap_L2);
-      while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) ) {
-         elems_seen++;
-         if (0 != (elem->base & (Addr)0xFFFF))
-            return "64-bit: nonzero .base & 0xFFFF in auxmap_L2";
-         if (elem->base <= MAX_PRIMARY_ADDRESS)
-            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L2";
-         if (elem->sm == NULL)
-            return "64-bit: .sm in _L2 is NULL";
-         if (!is_distinguished_sm(elem->sm))
-            (*n_secmaps_found)++;
-      }
-      if (elems_seen != n_auxmap_L2_nodes)
-         return "64-bit: disagreement on number of elems in _L2";
-      /* Check L1-L2 correspondence */
-      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0 && auxmap_L1[i].ent == NULL)
-            continue;
-         if (0 != (auxmap_L1[i].base & (Addr)0xFFFF))
-            return "64-bit: nonzero .base & 0xFFFF in auxmap_L1";
-         if (auxmap_L1[i].base <= MAX_PRIMARY_ADDRESS)
-            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L1";
-         if (auxmap_L1[i].ent == NULL)
-            return "64-bit: .ent is NULL in auxmap_L1";
-         if (auxmap_L1[i].ent->base != auxmap_L1[i].base)
-            return "64-bit: _L1 and _L2 bases are inconsistent";
-         /* Look it up in auxmap_L2. */
-         key.base = auxmap_L1[i].base;
-         key.sm   = 0;
-         res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-         if (res == NULL)
-            return "64-bit: _L1 .base not found in _L2";
-         if (res != auxmap_L1[i].ent)
-            return "64-bit: _L1 .ent disagrees with _L2 entry";
-      }
-      /* Check L1 contains no duplicates */
-      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0)
-            continue;
-	 for (j = i+1; j < N_AUXMAP_L1; j++) {
-            if (auxmap_L1[j].base == 0)
-               continue;
-            if (auxmap_L1[j].base == auxmap_L1[i].base)
-               return "64-bit: duplicate _L1 .base entries";
-         }
-      }
+   UWord i;
+   for (i = 0; i < RADIX_SIZE; i++) {
+      radix_empty_l3.sm[i] = &sm_distinguished[SM_DIST_NOCHECK];
+      radix_empty_l2.l3[i] = &radix_empty_l3;
+      radix_l1[i]          = &radix_empty_l2;
    }
-   return NULL; /* ok */
 }
 
-static void insert_into_auxmap_L1_at ( Word rank, AuxMapEnt* ent )
+/* Return the slot for 'a', or NULL if no node covers it yet. */
+static INLINE SecMap** maybe_find_in_radix ( Addr a )
 {
-   Word i;
-   tl_assert(ent);
-   tl_assert(rank >= 0 && rank < N_AUXMAP_L1);
-   for (i = N_AUXMAP_L1-1; i > rank; i--)
-      auxmap_L1[i] = auxmap_L1[i-1];
-   auxmap_L1[rank].base = ent->base;
-   auxmap_L1[rank].ent  = ent;
+   RadixL3* l3;
+   l3 = radix_l1[radix_ix1(a)]->l3[radix_ix2(a)];
+   if (l3 == &radix_empty_l3)
+      return NULL;
+   return &l3->sm[radix_ix3(a)];
 }
 
-static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
+static SecMap** find_or_alloc_in_radix ( Addr a )
 {
-   AuxMapEnt  key;
-   AuxMapEnt* res;
-   Word       i;
+   RadixL2** l2p;
+   RadixL3** l3p;
 
    tl_assert(a > MAX_PRIMARY_ADDRESS);
-   a &= ~(Addr)0xFFFF;
-
-   /* First search the front-cache, which is a self-organising
-      list containing the most popular entries. */
-
-   if (LIKELY(auxmap_L1[0].base == a))
-      return auxmap_L1[0].ent;
-   if (LIKELY(auxmap_L1[1].base == a)) {
-      Addr       t_base = auxmap_L1[0].base;
-      AuxMapEnt* t_ent  = auxmap_L1[0].ent;
-      auxmap_L1[0].base = auxmap_L1[1].base;
-      auxmap_L1[0].ent  = auxmap_L1[1].ent;
-      auxmap_L1[1].base = t_base;
-      auxmap_L1[1].ent  = t_ent;
-      return auxmap_L1[0].ent;
-   }
-
-   n_auxmap_L1_searches++;
-
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      if (auxmap_L1[i].base == a) {
-         break;
-      }
+   l2p = &radix_l1[radix_ix1(a)];
+   if (UNLIKELY(*l2p == &radix_empty_l2)) {
+      *l2p = VG_(malloc)("og.radix.1", sizeof(RadixL2));
+      VG_(memcpy)(*l2p, &radix_empty_l2, sizeof(RadixL2));
+      n_radix_L2_nodes++;
    }
-   tl_assert(i >= 0 && i <= N_AUXMAP_L1);
-
-   n_auxmap_L1_cmps += (ULong)(i+1);
-
-   if (i < N_AUXMAP_L1) {
-      if (i > 0) {
-         Addr       t_base = auxmap_L1[i-1].base;
-         AuxMapEnt* t_ent  = auxmap_L1[i-1].ent;
-         auxmap_L1[i-1].base = auxmap_L1[i-0].base;
-         auxmap_L1[i-1].ent  = auxmap_L1[i-0].ent;
-         auxmap_L1[i-0].base = t_base;
-         auxmap_L1[i-0].ent  = t_ent;
-         i--;
-      }
-      return auxmap_L1[i].ent;
+   l3p = &(*l2p)->l3[radix_ix2(a)];
+   if (UNLIKELY(*l3p == &radix_empty_l3)) {
+      *l3p = VG_(malloc)("og.radix.2", sizeof(RadixL3));
+      VG_(memcpy)(*l3p, &radix_empty_l3, sizeof(RadixL3));
+      n_radix_L3_nodes++;
    }
-
-   n_auxmap_L2_searches++;
-
-   /* First see if we already have it. */
-   key.base = a;
-   key.sm   = 0;
-
-   res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-   if (res)
-      insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, res );
-   return res;
+   return &(*l3p)->sm[radix_ix3(a)];
 }
 
-static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
+/* Call fn on every secmap slot, in address order: first the primary
+   map, then every populated radix leaf.  fn may replace *sm_ptr. */
+static void foreach_secmap ( void (*fn)(Addr base, SecMap** sm_ptr,
+                                        void* opaque),
+                             void* opaque )
 {
-   AuxMapEnt *nyu, *res;
-
-   /* First see if we already have it. */
-   res = maybe_find_in_auxmap( a );
-   if (LIKELY(res))
-      return res;
-
-   /* Ok, there's no entry in the secondary map, so we'll have
-      to allocate one. */
-   a &= ~(Addr)0xFFFF;
-
-   nyu = (AuxMapEnt*) VG_(OSetGen_AllocNode)( auxmap_L2, sizeof(AuxMapEnt) );
-   tl_assert(nyu);
-   nyu->base = a;
-   nyu->sm   = &sm_distinguished[SM_DIST_NOCHECK];
-   VG_(OSetGen_Insert)( auxmap_L2, nyu );
-   insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
-   n_auxmap_L2_nodes++;
-   return nyu;
+   UWord i1, i2, i3;
+
+   for (i3 = 0; i3 < N_PRIMARY_MAP; i3++)
+      fn((Addr)i3 << 16, &primary_map[i3], opaque);
+   for (i1 = 0; i1 < RADIX_SIZE; i1++) {
+      RadixL2* l2 = radix_l1[i1];
+      if (l2 == &radix_empty_l2)
+         continue;
+      for (i2 = 0; i2 < RADIX_SIZE; i2++) {
+         RadixL3* l3 = l2->l3[i2];
+         if (l3 == &radix_empty_l3)
+            continue;
+         for (i3 = 0; i3 < RADIX_SIZE; i3++) {
+            Addr base = (Addr)(((ULong)i1 << 48) | ((ULong)i2 << 32)
+                               | ((ULong)i3 << 16));
+            if (base > MAX_PRIMARY_ADDRESS)
+               fn(base, &l3->sm[i3], opaque);
+         }
+      }
+   }
 }
 
 /* --------------- SecMap fundamentals --------------- */
 
 // In all these, 'low' means it's definitely in the main primary map,
-// 'high' means it's definitely in the auxiliary table.
+// 'high' means it's definitely in the radix tree.
 
 static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 {
@@ -402,8 +326,7 @@ static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 
 static INLINE SecMap** get_secmap_high_ptr ( Addr a )
 {
-   AuxMapEnt* am = find_or_alloc_in_auxmap(a);
-   return &am->sm;
+   return find_or_alloc_in_radix(a);
 }
 
 static SecMap** get_secmap_ptr ( Addr a )
@@ -420,7 +343,7 @@ static INLINE SecMap* get_secmap_for_reading_low ( Addr a )
 
 static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
 {
-   return *get_secmap_high_ptr(a);
+   return radix_l1[radix_ix1(a)]->l3[radix_ix2(a)]->sm[radix_ix3(a)];
 }
 
 static INLINE SecMap* get_secmap_for_writing_low(Addr a)
@@ -439,10 +362,9 @@ static INLINE SecMap* get_secmap_for_writing_high ( Addr a )
    return *p;
 }
 
-/* Produce the secmap for 'a', either from the primary map or by
-   ensuring there is an entry for it in the aux primary map.  The
-   secmap may be a distinguished one as the caller will only want to
-   be able to read it. 
+/* Produce the secmap for 'a' from the primary map or the radix tree.
+   The secmap may be a distinguished one as the caller will only want
+   to be able to read it.  This never allocates.
 */
 static INLINE SecMap* get_secmap_for_reading ( Addr a )
 {
@@ -452,7 +374,7 @@ static INLINE SecMap* get_secmap_for_reading ( Addr a )
 }
 
 /* Produce the secmap for 'a', either from the primary map or by
-   ensuring there is an entry for it in the aux primary map.  The
+   ensuring there is an entry for it in the radix tree.  The
    secmap may not be a distinguished one, since the caller will want
    to be able to write it.  If it is a distinguished secondary, make a
    writable copy of it, install it, and return the copy instead.  (COW
@@ -465,26 +387,28 @@ static SecMap* get_secmap_for_writing ( Addr a )
           : get_secmap_for_writing_high(a) );
 }
 
-/* If 'a' has a SecMap, produce it.  Else produce NULL.  But don't
-   allocate one if one doesn't already exist.  This is used by the
-   leak checker.
+/* If 'a' has a SecMap slot, produce its contents.  Else produce NULL.
+   But don't allocate one if one doesn't already exist.
 */
 static SecMap* maybe_get_secmap_for ( Addr a )
 {
    if (a <= MAX_PRIMARY_ADDRESS) {
       return get_secmap_for_reading_low(a);
    } else {
-      AuxMapEnt* am = maybe_find_in_auxmap(a);
-      return am ? am->sm : NULL;
+      SecMap** p = maybe_find_in_radix(a);
+      return p ? *p : NULL;
    }
 }
 
 /* --------------- Fundamental functions --------------- */
 
+// These take a guest address; which of the four 2-bit fields it
+// selects depends on the granularity.
+
 static INLINE
 void insert_abits2_into_abits8 ( Addr a, UChar abits2, UChar* abits8 )
 {
-   UInt shift =  (a & 3)  << 1;        // shift by 0, 2, 4, or 6
+   UInt shift =  ((a >> og_gran_shift) & 3)  << 1; // shift by 0, 2, 4, or 6
    *abits8  &= ~(0x3     << shift);   // mask out the two old bits
    *abits8  |=  (abits2 << shift);   // mask  in the two new bits
 }
@@ -493,8 +417,8 @@ static INLINE
 void insert_abits4_into_abits8 ( Addr a, UChar abits4, UChar* abits8 )
 {
    UInt shift;
-   tl_assert(VG_IS_2_ALIGNED(a));      // Must be 2-aligned
-   shift     =  (a & 2)   << 1;        // shift by 0 or 4
+   tl_assert(VG_IS_2_ALIGNED(a >> og_gran_shift)); // Must be 2-aligned
+   shift     =  ((a >> og_gran_shift) & 2)   << 1; // shift by 0 or 4
    *abits8 &= ~(0xf      << shift);   // mask out the four old bits
    *abits8 |=  (abits4 << shift);    // mask  in the four new bits
 }
@@ -502,7 +426,7 @@ void insert_abits4_into_abits8 ( Addr a, UChar abits4, UChar* abits8 )
 static INLINE
 UChar extract_abits2_from_abits8 ( Addr a, UChar abits8 )
 {
-   UInt shift = (a & 3) << 1;          // shift by 0, 2, 4, or 6
+   UInt shift = ((a >> og_gran_shift) & 3) << 1; // shift by 0, 2, 4, or 6
    abits8 >>= shift;                  // shift the two bits to the bottom
    return 0x3 & abits8;               // mask out the rest
 }
@@ -511,14 +435,14 @@ static INLINE
 UChar extract_abits4_from_abits8 ( Addr a, UChar abits8 )
 {
    UInt shift;
-   tl_assert(VG_IS_2_ALIGNED(a));      // Must be 2-aligned
-   shift = (a & 2) << 1;               // shift by 0 or 4
+   tl_assert(VG_IS_2_ALIGNED(a >> og_gran_shift)); // Must be 2-aligned
+   shift = ((a >> og_gran_shift) & 2) << 1;        // shift by 0 or 4
    abits8 >>= shift;                  // shift the four bits to the bottom
    return 0xf & abits8;               // mask out the rest
 }
 
 // Note that these four are only used in slow cases.  The fast cases do
-// clever things like combine the auxmap check (in
+// clever things like combine the radix check (in
 // get_secmap_{read,writ}able) with alignment checks.
 
 // *** WARNING! ***
@@ -564,11 +488,48 @@ void set_abits8_for_aligned_word32 ( Addr a, UChar abits8 )
 }
 
 
+/* Set every state covering [a, a+len), which must lie within sm's
+   64KB, rounding outwards to whole granules.  Fields are set one at a
+   time up to an abits8 boundary, then whole abits8 bytes at once. */
+static void set_abits_in_sm ( SecMap* sm, Addr a, SizeT len, UWord abits16 )
+{
+   UWord gsz    = ((UWord)1) << og_gran_shift;
+   Addr  end    = a + len;
+   UChar abits2 = abits16 & 0x3;
+   SizeT n;
+
+   a = VG_ROUNDDN(a, gsz);
+   // 1 granule steps
+   while (a < end && ((a >> og_gran_shift) & 3) != 0) {
+      insert_abits2_into_abits8( a, abits2, &(sm->abits8[SM_OFF(a)]) );
+      a += gsz;
+   }
+   // 4 granule steps
+   if (a < end) {
+      n = (end - a) >> (og_gran_shift + 2);
+      VG_(memset)(&(sm->abits8[SM_OFF(a)]), abits16 & 0xff, n);
+      a += n << (og_gran_shift + 2);
+   }
+   // 1 granule steps
+   while (a < end) {
+      insert_abits2_into_abits8( a, abits2, &(sm->abits8[SM_OFF(a)]) );
+      a += gsz;
+   }
+}
+
+/* # set_address_range_perms calls, and the bytes they covered by
+   path: set granule by granule in a secmap, whole secmaps pointed at a
+   distinguished secmap, whole secmaps filled, and bytes that already
+   had the right state. */
+static ULong n_sarp_calls          = 0;
+static ULong n_sarp_bytes_partial  = 0;
+static ULong n_sarp_bytes_dsm      = 0;
+static ULong n_sarp_bytes_filled   = 0;
+static ULong n_sarp_bytes_skipped  = 0;
+
 static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
                                       UWord dsm_num )
 {
-   UWord    sm_off, sm_off16;
-   UWord    abits2 = abits16 & 0x3;
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
    SecMap*  sm;
@@ -581,8 +542,20 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
              A_BITS16_UNREFERABLE == abits16 ||
              A_BITS16_REFCHECK == abits16);
 
+   /* There is no distinguished REFCHECK secmap, so REFCHECK ranges
+      always get real secmaps. */
+   if (dsm_num == SM_DIST_NONE) {
+      tl_assert(A_BITS16_REFCHECK == abits16);
+      example_dsm = NULL;
+   } else {
+      tl_assert(dsm_num <= SM_DIST_UNREFERABLE);
+      example_dsm = &sm_distinguished[dsm_num];
+      tl_assert(example_dsm->abits8[0] == (abits16 & 0xff));
+   }
+
    if (lenT == 0)
       return;
+   n_sarp_calls++;
 
    if (lenT > 256 * 1024 * 1024) {
       if (VG_(clo_verbosity) > 0 && !VG_(clo_xml)) {
@@ -602,6 +575,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
       // Nb: We don't have to worry about updating the sec-V-bits table
       // after these set_abits2() calls because this code never writes
       // VA_BITS2_PARTDEFINED values.
+      UWord abits2 = abits16 & 0x3;
       SizeT i;
       for (i = 0; i < lenT; i++) {
          set_abits2(a + i, abits2);
@@ -612,13 +586,15 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
 
    aNext = start_of_this_sm(a) + SM_SIZE;
    len_to_next_secmap = aNext - a;
-   if ( lenT <= len_to_next_secmap ) {
-      lenA = lenT;
-      lenB = 0;
-   } else if (is_start_of_sm(a)) {
+   if (is_start_of_sm(a)) {
+      // Test this first so that a range covering exactly one whole
+      // sec-map collapses to the distinguished sec-map too.
       lenA = 0;
       lenB = lenT;
       goto part2;
+   } else if ( lenT <= len_to_next_secmap ) {
+      lenA = lenT;
+      lenB = 0;
    } else {
       // Range spans two or more sec-maps, first one is partial.
       lenA = len_to_next_secmap;
@@ -637,6 +613,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
    if (is_distinguished_sm(*sm_ptr)) {
       if (*sm_ptr == example_dsm) {
          // Sec-map already has the V+A bits that we want, so skip.
+         n_sarp_bytes_skipped += lenA;
          a    = aNext;
          lenA = 0;
       } else {
@@ -645,30 +622,11 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
    }
    sm = *sm_ptr;
 
-   // 1 byte steps
-   while (True) {
-      if (VG_IS_8_ALIGNED(a)) break;
-      if (lenA < 1)           break;
-      sm_off = SM_OFF(a);
-      insert_abits2_into_abits8( a, abits2, &(sm->abits8[sm_off]) );
-      a    += 1;
-      lenA -= 1;
-   }
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenA < 8) break;
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->abits8))[sm_off16] = abits16;
-      a    += 8;
-      lenA -= 8;
-   }
-   // 1 byte steps
-   while (True) {
-      if (lenA < 1) break;
-      sm_off = SM_OFF(a);
-      insert_abits2_into_abits8( a, abits2, &(sm->abits8[sm_off]) );
-      a    += 1;
-      lenA -= 1;
+   if (lenA > 0) {
+      n_sarp_bytes_partial += lenA;
+      set_abits_in_sm(sm, a, lenA, abits16);
+      a    += lenA;
+      lenA  = 0;
    }
 
    // We've finished the first sec-map.  Is that it?
@@ -685,12 +643,28 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
    while (True) {
       if (lenB < SM_SIZE) break;
       tl_assert(is_start_of_sm(a));
+      // Don't allocate radix nodes just to say NOCHECK.
+      if (example_dsm == &sm_distinguished[SM_DIST_NOCHECK]
+          && get_secmap_for_reading(a) == example_dsm) {
+         n_sarp_bytes_skipped += SM_SIZE;
+         lenB -= SM_SIZE;
+         a    += SM_SIZE;
+         continue;
+      }
       sm_ptr = get_secmap_ptr(a);
-      if (!is_distinguished_sm(*sm_ptr)) {
-         VG_(free)((void *)*sm_ptr);
+      if (example_dsm == NULL) {
+         if (is_distinguished_sm(*sm_ptr))
+            *sm_ptr = copy_for_writing(*sm_ptr);
+         VG_(memset)((*sm_ptr)->abits8, abits16 & 0xff, sm_bytes);
+         n_sarp_bytes_filled += SM_SIZE;
+      } else {
+         if (!is_distinguished_sm(*sm_ptr)) {
+            free_secmap(*sm_ptr);
+         }
+         // Make the sec-map entry point to the example DSM
+         *sm_ptr = example_dsm;
+         n_sarp_bytes_dsm += SM_SIZE;
       }
-      // Make the sec-map entry point to the example DSM
-      *sm_ptr = example_dsm;
       lenB -= SM_SIZE;
       a    += SM_SIZE;
    }
@@ -709,6 +683,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
    sm_ptr = get_secmap_ptr(a);
    if (is_distinguished_sm(*sm_ptr)) {
       if (*sm_ptr == example_dsm) {
+         n_sarp_bytes_skipped += lenB;
          return;
       } else {
          *sm_ptr = copy_for_writing(*sm_ptr);
@@ -716,336 +691,1603 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord abits16,
    }
    sm = *sm_ptr;
 
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenB < 8) break;
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->abits8))[sm_off16] = abits16;
-      a    += 8;
-      lenB -= 8;
+   n_sarp_bytes_partial += lenB;
+   set_abits_in_sm(sm, a, lenB, abits16);
+}
+
+
+/* --------------- Secmap compaction --------------- */
+
+/* If every byte in sm is in the same state and there is a
+   distinguished secmap for that state, return it; else NULL. */
+static SecMap* uniform_dsm_for ( SecMap* sm )
+{
+   const UWord* w = (const UWord*)sm->abits8;
+   UWord first    = w[0];
+   UWord i;
+   SecMap* dsm;
+
+   switch (first & 0xff) {
+   case A_BITS8_NOCHECK:     dsm = &sm_distinguished[SM_DIST_NOCHECK];     break;
+   case A_BITS8_UNWRITABLE:  dsm = &sm_distinguished[SM_DIST_UNWRITABLE];  break;
+   case A_BITS8_UNREFERABLE: dsm = &sm_distinguished[SM_DIST_UNREFERABLE]; break;
+   default: return NULL;
    }
-   // 1 byte steps
-   while (True) {
-      if (lenB < 1) return;
-      sm_off = SM_OFF(a);
-      insert_abits2_into_abits8( a, abits2, &(sm->abits8[sm_off]) );
-      a    += 1;
-      lenB -= 1;
+   if (first != ((const UWord*)dsm->abits8)[0])
+      return NULL;
+   for (i = 1; i < sm_bytes / sizeof(UWord); i++) {
+      if (w[i] != first)
+         return NULL;
    }
+   return dsm;
 }
 
+/* Hand *sm_ptr back to the distinguished secmap if it has become
+   uniform.  Returns True if it was freed. */
+static Bool maybe_reclaim_secmap ( SecMap** sm_ptr )
+{
+   SecMap* dsm;
+   if (is_distinguished_sm(*sm_ptr))
+      return False;
+   dsm = uniform_dsm_for(*sm_ptr);
+   if (dsm == NULL)
+      return False;
+   free_secmap(*sm_ptr);
+   *sm_ptr = dsm;
+   n_sm_reclaimed++;
+   return True;
+}
 
-/*------------------------------------------------------------*/
-/*--- Event handlers called from generated code            ---*/
-/*------------------------------------------------------------*/
+static void compact_secmap_cb ( Addr base, SecMap** sm_ptr, void* opaque )
+{
+   if (maybe_reclaim_secmap(sm_ptr))
+      (*(UWord*)opaque)++;
+}
 
-static void
-OG_(store_check8)(Addr a, UWord data8){
-    if (get_abits2(a) == A_BITS2_UNWRITABLE) {
-        VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                UnwritableErr, a, NULL, NULL);
-    }
+/* Walk the primary map and the radix tree and reclaim all uniform
+   secmaps.  Returns the number of bytes freed. */
+static SizeT compact_secmaps ( void )
+{
+   UWord n_freed = 0;
+
+   foreach_secmap(compact_secmap_cb, &n_freed);
+   n_sm_compactions++;
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "secmap compaction: %lu secmaps (%lu bytes) reclaimed, "
+                   "%llu in use\n",
+                   n_freed, n_freed * sm_bytes,
+                   n_issued_SMs - n_deissued_SMs);
+   return n_freed * sm_bytes;
 }
 
-static void
-OG_(store_check16)(Addr a, UWord data16){
-    if (get_abits2(a) == A_BITS2_UNWRITABLE) {
-        VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                UnwritableErr, a, NULL, NULL);
-    }
+/* Run a compaction if copy_for_writing asked for one.  If it could
+   not bring the number of secmaps in use below half the limit, the
+   live set really is that big, so double the limit to avoid
+   rescanning it over and over. */
+static void compact_secmaps_if_pending ( void )
+{
+   if (LIKELY(!sm_compact_pending))
+      return;
+   sm_compact_pending = False;
+   compact_secmaps();
+   if (n_issued_SMs - n_deissued_SMs > sm_compact_limit / 2)
+      sm_compact_limit *= 2;
 }
 
-static void
-OG_(store_check32)(Addr a, UWord data32){
-    if (get_abits2(a) == A_BITS2_UNWRITABLE) {
-        VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                UnwritableErr, a, NULL, NULL);
-    }
-    else if (get_abits2(a) == A_BITS2_REFCHECK &&
-             get_abits2(data32) == A_BITS2_UNREFERABLE) {
-        VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                UnreferableErr, (Addr)data32, NULL, NULL);
-    }
+/* --------------- Runs of one state --------------- */
+
+/* Anything that wants the shadow state of a large range summarised
+   feeds it, secmap by secmap, through a RunAcc, which joins adjacent
+   pieces in the same state and calls fn once per maximal run.
+   Distinguished secmaps go in as one piece; others are read a word of
+   abits8 at a time where it is uniform, so cost goes with the number
+   of state changes rather than the number of bytes. */
+
+typedef
+   struct {
+      Addr  start;    // the run being built; len == 0 if none
+      SizeT len;
+      UChar abits2;
+      void  (*fn)(Addr a, SizeT len, UChar abits2, void* opaque);
+      void* opaque;
+   }
+   RunAcc;
+
+static void init_run_acc ( RunAcc* acc,
+                           void (*fn)(Addr, SizeT, UChar, void*),
+                           void* opaque )
+{
+   acc->start  = 0;
+   acc->len    = 0;
+   acc->abits2 = A_BITS2_NOCHECK;
+   acc->fn     = fn;
+   acc->opaque = opaque;
 }
 
-static void
-OG_(store_check64)(Addr a, ULong data64, UInt wordSize){
-    if (wordSize == 32) {
-        OG_(store_check32)(a, (Word)data64);
-        OG_(store_check32)(a, (Word)(data64 >> 32));
-    }
-    else {
-        if (get_abits2(a) == A_BITS2_UNWRITABLE) {
-            VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                    UnwritableErr, a, NULL, NULL);
-        }
-        else if (get_abits2(a) == A_BITS2_REFCHECK &&
-                 get_abits2(data64) == A_BITS2_UNREFERABLE) {
-            VG_(maybe_record_error)(VG_(get_running_tid)(),
-                                    UnreferableErr, (Addr)data64, NULL, NULL);
-        }
-    }
+static INLINE void add_to_run ( RunAcc* acc, Addr a, SizeT len, UChar abits2 )
+{
+   if (acc->len > 0 && acc->abits2 == abits2 && acc->start + acc->len == a) {
+      acc->len += len;
+      return;
+   }
+   if (acc->len > 0)
+      acc->fn(acc->start, acc->len, acc->abits2, acc->opaque);
+   acc->start  = a;
+   acc->len    = len;
+   acc->abits2 = abits2;
+}
+
+static void flush_run ( RunAcc* acc )
+{
+   if (acc->len > 0)
+      acc->fn(acc->start, acc->len, acc->abits2, acc->opaque);
+   acc->len = 0;
+}
+
+/* Add bytes [base+lo, base+hi) of the secmap sm, which covers base. */
+static void add_secmap_to_run ( RunAcc* acc, SecMap* sm, Addr base,
+                                UWord lo, UWord hi )
+{
+   const UWord gran   = (UWord)1 << og_gran_shift;
+   const UWord wbytes = sizeof(UWord) * 4 * gran;   // bytes per abits8 word
+   UWord off = lo;
+
+   tl_assert(lo <= hi && hi <= SM_SIZE);
+   if (is_distinguished_sm(sm)) {
+      /* SM_DIST_* are the A_BITS2_* of each distinguished secmap. */
+      if (hi > lo)
+         add_to_run(acc, base + lo, hi - lo, (UChar)(sm - sm_distinguished));
+      return;
+   }
+   while (off < hi) {
+      UWord step;
+      if ((off & (wbytes - 1)) == 0 && hi - off >= wbytes) {
+         UWord w = *(const UWord*)&sm->abits8[SM_OFF(off)];
+         /* Uniform iff it is its low 2 bits repeated. */
+         if (w == (w & 3) * (~(UWord)0 / 3)) {
+            add_to_run(acc, base + off, wbytes, (UChar)(w & 3));
+            off += wbytes;
+            continue;
+         }
+      }
+      step = gran - (off & (gran - 1));
+      if (step > hi - off)
+         step = hi - off;
+      add_to_run(acc, base + off, step,
+                 extract_abits2_from_abits8(base + off,
+                                            sm->abits8[SM_OFF(off)]));
+      off += step;
+   }
+}
+
+/* Add [a, a+len), which must not wrap around. */
+static void add_range_to_run ( RunAcc* acc, Addr a, SizeT len )
+{
+   while (len > 0) {
+      Addr  base = start_of_this_sm(a);
+      UWord lo   = a - base;
+      UWord hi   = len < SM_SIZE - lo ? lo + len : SM_SIZE;
+      add_secmap_to_run(acc, get_secmap_for_reading(a), base, lo, hi);
+      a   += hi - lo;
+      len -= hi - lo;
+   }
 }
 
 
 /*------------------------------------------------------------*/
-/*--- Instrument                                           ---*/
+/*--- Origins of UNREFERABLE ranges                        ---*/
 /*------------------------------------------------------------*/
 
-typedef  IRExpr  IRAtom;
+/* With --track-unreferable-origins=yes every MAKE_UNREFERABLE request
+   records a stack, so that an UnreferableError can say where its value
+   was made unreferable (typically the GC sweep that freed it).
 
-/* build various kinds of expressions */
-#define triop(_op, _arg1, _arg2, _arg3) \
-                                 IRExpr_Triop((_op),(_arg1),(_arg2),(_arg3))
-#define binop(_op, _arg1, _arg2) IRExpr_Binop((_op),(_arg1),(_arg2))
-#define unop(_op, _arg)          IRExpr_Unop((_op),(_arg))
-#define mkU1(_n)                 IRExpr_Const(IRConst_U1(_n))
-#define mkU8(_n)                 IRExpr_Const(IRConst_U8(_n))
-#define mkU16(_n)                IRExpr_Const(IRConst_U16(_n))
-#define mkU32(_n)                IRExpr_Const(IRConst_U32(_n))
-#define mkU64(_n)                IRExpr_Const(IRConst_U64(_n))
-#define mkV128(_n)               IRExpr_Const(IRConst_V128(_n))
-#define mkexpr(_tmp)             IRExpr_RdTmp((_tmp))
+   Ranges live in an OSet ordered by start address and never overlap: a
+   new range trims or replaces the older ones under it.  The nodes come
+   from a PoolAlloc and are also chained in order of age, so that once
+   there are more than --unreferable-origins-max of them the oldest can
+   be evicted.  None of this is touched unless the option is given. */
 
-static IRAtom* assignNew ( IRSB* bbOut, IRType ty, IRExpr* e )
+Bool OG_(clo_track_unreferable_origins) = False;
+UInt OG_(clo_unreferable_origins_depth) = 12;
+UInt OG_(clo_unreferable_origins_max)   = 1000000;
+
+#define MAX_ORIGIN_DEPTH 50
+
+typedef
+   struct _OriginRange {
+      Addr                 start;   // the OSet key
+      SizeT                len;
+      ExeContext*          ec;
+      struct _OriginRange* older;
+      struct _OriginRange* newer;
+   }
+   OriginRange;
+
+static OSet*        origins         = NULL;
+static PoolAlloc*   origin_pool     = NULL;
+static SizeT        origin_node_szB = 0;
+static OriginRange* oldest_origin   = NULL;
+static OriginRange* newest_origin   = NULL;
+
+/* # ranges held, and # evicted to stay under the limit. */
+static ULong n_origins         = 0;
+static ULong n_origins_evicted = 0;
+
+/* The OSet asks for the same node size every time, so the pool is
+   created on the first request. */
+static void* origin_node_alloc ( const HChar* cc, SizeT szB )
 {
-   IRTemp   t;
+   if (origin_pool == NULL) {
+      origin_node_szB = szB;
+      origin_pool = VG_(newPA)(szB, 1000, VG_(malloc),
+                               "og.origins.pool", VG_(free));
+   }
+   tl_assert(szB == origin_node_szB);
+   return VG_(allocEltPA)(origin_pool);
+}
 
-   t = newIRTemp(bbOut->tyenv, ty);
-   addStmtToIRSB(bbOut, IRStmt_WrTmp(t, e));
-   return IRExpr_RdTmp(t);
+static void origin_node_free ( void* p )
+{
+   VG_(freeEltPA)(origin_pool, p);
 }
 
-static IRAtom* zwidenToHostWord (IRSB* bbOut, IRType tyH, IRAtom* atom)
+/* An address compares equal to the range containing it. */
+static Word cmp_origin_range ( const void* key, const void* elem )
 {
-   IRType ty;
+   Addr               a = *(const Addr*)key;
+   const OriginRange* r = elem;
 
-   ty  = typeOfIRExpr(bbOut->tyenv, atom);
+   if (a < r->start)           return -1;
+   if (a - r->start >= r->len) return 1;
+   return 0;
+}
 
-   if (tyH == Ity_I32) {
-      switch (ty) {
-         case Ity_F32:
-            return assignNew(bbOut, tyH, unop(Iop_ReinterpF32asI32, atom));
-         case Ity_D32:
-             return assignNew(bbOut, tyH, unop(Iop_64to32,
-                    unop(Iop_ReinterpD64asI64, unop(Iop_D32toD64, atom))));
-         case Ity_I32:
-            return atom;
-         case Ity_I16:
-            return assignNew(bbOut, tyH, unop(Iop_16Uto32, atom));
-         case Ity_I8:
-            return assignNew(bbOut, tyH, unop(Iop_8Uto32, atom));
-         default:
-            goto unhandled;
-      }
-   } else
-   if (tyH == Ity_I64) {
-      switch (ty) {
-         case Ity_F32:
-            return assignNew(bbOut, tyH, unop(Iop_32Uto64,
-                   assignNew(bbOut, Ity_I32, unop(Iop_ReinterpF32asI32, atom))));
-         case Ity_D32:
-            return assignNew(bbOut, tyH, unop(Iop_ReinterpD64asI64,
-                   assignNew(bbOut, Ity_D64, unop(Iop_D32toD64, atom))));
-         case Ity_I32:
-            return assignNew(bbOut, tyH, unop(Iop_32Uto64, atom));
-         case Ity_I16:
-            return assignNew(bbOut, tyH, unop(Iop_32Uto64, 
-                   assignNew(bbOut, Ity_I32, unop(Iop_16Uto32, atom))));
-         case Ity_I8:
-            return assignNew(bbOut, tyH, unop(Iop_32Uto64, 
-                   assignNew(bbOut, Ity_I32, unop(Iop_8Uto32, atom))));
-         default:
-            goto unhandled;
+static void link_origin_after ( OriginRange* prev, OriginRange* r )
+{
+   r->older = prev;
+   r->newer = prev ? prev->newer : NULL;
+   if (r->newer) r->newer->older = r; else newest_origin = r;
+   if (prev)     prev->newer     = r; else oldest_origin = r;
+   n_origins++;
+}
+
+static void delete_origin ( OriginRange* r )
+{
+   VG_(OSetGen_Remove)(origins, &r->start);
+   if (r->older) r->older->newer = r->newer; else oldest_origin = r->newer;
+   if (r->newer) r->newer->older = r->older; else newest_origin = r->older;
+   VG_(OSetGen_FreeNode)(origins, r);
+   n_origins--;
+}
+
+/* Drop [a, a+len) from the index, trimming ranges that stick out of
+   it.  Trimmed pieces keep their place in the age order. */
+static void forget_origins ( Addr a, SizeT len )
+{
+   Addr         end = a + len;
+   Addr         r_end;
+   OriginRange *r, *right;
+
+   while (True) {
+      VG_(OSetGen_ResetIterAt)(origins, &a);
+      r = VG_(OSetGen_Next)(origins);
+      if (r == NULL || r->start >= end)
+         return;
+      r_end = r->start + r->len;
+      if (r->start < a) {
+         // r contains a.  Shrinking it in place keeps the key; it must
+         // be shrunk before any right-hand piece goes in.
+         r->len = a - r->start;
+         if (r_end > end) {
+            right = VG_(OSetGen_AllocNode)(origins, sizeof(OriginRange));
+            right->start = end;
+            right->len   = r_end - end;
+            right->ec    = r->ec;
+            VG_(OSetGen_Insert)(origins, right);
+            link_origin_after(r, right);
+         }
+      } else if (r_end > end) {
+         VG_(OSetGen_Remove)(origins, &r->start);
+         r->start = end;
+         r->len   = r_end - end;
+         VG_(OSetGen_Insert)(origins, r);
+      } else {
+         delete_origin(r);
       }
-   } else {
-      goto unhandled;
    }
-  unhandled:
-   VG_(printf)("\nty = "); ppIRType(ty); VG_(printf)("\n");
-   VG_(tool_panic)("zwidenToHostWord");
 }
 
-static void
-insert_store_checker(IRSB* bbOut, IRAtom* addr, IRAtom* data, IRAtom* guard, IRType tyAddr)
+static void record_unreferable_origin ( ThreadId tid, Addr a, SizeT len )
 {
-    void* helper = NULL;
-    const HChar* hname = NULL;
-    IROp     mkAdd;
-    IRType   ty;
-    IRAtom*  wordSize = NULL;
+   Addr         ips[MAX_ORIGIN_DEPTH];
+   UInt         n_ips;
+   OriginRange* r;
 
-    mkAdd = (tyAddr == Ity_I32) ? Iop_Add32 : Iop_Add64;
-    tl_assert(tyAddr == Ity_I32 || tyAddr == Ity_I64);
+   if (len == 0)
+      return;
+   if (origins == NULL)
+      origins = VG_(OSetGen_Create)(offsetof(OriginRange, start),
+                                    cmp_origin_range, origin_node_alloc,
+                                    "og.origins", origin_node_free);
+   forget_origins(a, len);
+
+   n_ips = VG_(get_StackTrace)(tid, ips, OG_(clo_unreferable_origins_depth),
+                               NULL, NULL, 0);
+   r = VG_(OSetGen_AllocNode)(origins, sizeof(OriginRange));
+   r->start = a;
+   r->len   = len;
+   r->ec    = VG_(make_ExeContext_from_StackTrace)(ips, n_ips);
+   VG_(OSetGen_Insert)(origins, r);
+   link_origin_after(newest_origin, r);
+
+   while (n_origins > OG_(clo_unreferable_origins_max)) {
+      delete_origin(oldest_origin);
+      n_origins_evicted++;
+   }
+}
 
-    ty = typeOfIRExpr(bbOut->tyenv, data);
+/* Fill in the origin fields of 'extra' for the unreferable address
+   'a', if one is known. */
+static void get_unreferable_origin ( Addr a, OgErrorExtra* extra )
+{
+   OriginRange* r = origins ? VG_(OSetGen_Lookup)(origins, &a) : NULL;
 
-    switch (ty) {
-    case Ity_V256:
-    case Ity_V128:
-    case Ity_I128:
-    case Ity_D128:
-    case Ity_F128:
-    case Ity_D64:
-    case Ity_F64:
-    case Ity_I64: helper = &OG_(store_check64);
-        hname = "OG_(store_check64)";
-        break;
-    case Ity_F32:
-    case Ity_D32:
-    case Ity_I32: helper = &OG_(store_check32);
-        hname = "OG_(store_check32)";
-        break;
-    case Ity_I16: helper = &OG_(store_check16);
-        hname = "OG_(store_check16)";
-        break;
-    case Ity_I8: helper = &OG_(store_check8);
-        hname = "OG_(store_check8)";
-        break;
-    default:
-        VG_(printf)("\nty = "); ppIRType(ty); VG_(printf)("\n");
-        VG_(tool_panic)("objgrind:insert_store_checker");
-    }
+   extra->origin       = r ? r->ec    : NULL;
+   extra->origin_start = r ? r->start : 0;
+   extra->origin_len   = r ? r->len   : 0;
+}
 
-    wordSize = mkU32(tyAddr == Ity_I32 ? 32 : 64);
-
-    if (UNLIKELY(ty == Ity_V256)) {
-        IRDirty *diQ0,    *diQ1,    *diQ2,    *diQ3;
-        IRAtom  *addrQ0,  *addrQ1,  *addrQ2,  *addrQ3;
-        IRAtom  *dataQ0,  *dataQ1,  *dataQ2,  *dataQ3;
-        IRAtom  *eBiasQ0, *eBiasQ1, *eBiasQ2, *eBiasQ3;
-
-        eBiasQ0 = tyAddr==Ity_I32 ? mkU32(0) : mkU64(0);
-        addrQ0  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasQ0));
-        dataQ0  = assignNew(bbOut, Ity_I64, unop(Iop_V256to64_0, data));
-        diQ0    = unsafeIRDirty_0_N(0, 
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_3( addrQ0, dataQ0, wordSize )
-            );
-
-        eBiasQ1 = tyAddr==Ity_I32 ? mkU32(8) : mkU64(8);
-        addrQ1  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasQ1));
-        dataQ1  = assignNew(bbOut, Ity_I64, unop(Iop_V256to64_1, data));
-        diQ1    = unsafeIRDirty_0_N(0, 
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_3( addrQ1, dataQ1, wordSize )
-            );
-
-        eBiasQ2 = tyAddr==Ity_I32 ? mkU32(16) : mkU64(16);
-        addrQ2  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasQ2));
-        dataQ2  = assignNew(bbOut, Ity_I64, unop(Iop_V256to64_2, data));
-        diQ2    = unsafeIRDirty_0_N(0, 
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_3( addrQ2, dataQ2, wordSize )
-            );
-
-        eBiasQ3 = tyAddr==Ity_I32 ? mkU32(24) : mkU64(24);
-        addrQ3  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasQ3));
-        dataQ3  = assignNew(bbOut, Ity_I64, unop(Iop_V256to64_3, data));
-        diQ3    = unsafeIRDirty_0_N(0, 
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_3( addrQ3, dataQ3, wordSize )
-            );
-
-        if (guard)
-            diQ0->guard = diQ1->guard = diQ2->guard = diQ3->guard = guard;
-
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diQ0));
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diQ1));
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diQ2));
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diQ3));
-    }
-    else if (UNLIKELY(ty == Ity_V128 || ty == Ity_I128 || ty == Ity_F128 || ty == Ity_D128)) {
-        IRDirty *diLo64, *diHi64;
-        IRAtom  *addrLo64, *addrHi64;
-        IRAtom  *dataLo64, *dataHi64;
-        IRAtom  *eBiasLo64, *eBiasHi64;
-        IRAtom *loOp, *hiOp;
-
-        switch (ty) {
-        case Ity_V128:
-            loOp = unop(Iop_V128to64, data);
-            hiOp = unop(Iop_V128HIto64, data);
-            break;
-        case Ity_I128:
-            loOp = unop(Iop_128to64, data);
-            hiOp = unop(Iop_128HIto64, data);
-            break;
-        case Ity_F128:
-            loOp = unop(Iop_F64toI64U, assignNew(bbOut, Ity_F64, unop(Iop_F128LOtoF64, data)));
-            hiOp = unop(Iop_F64toI64U, assignNew(bbOut, Ity_F64, unop(Iop_F128HItoF64, data)));
-            break;
-        case Ity_D128:
-            loOp = unop(Iop_D64toI64U, assignNew(bbOut, Ity_D64, unop(Iop_D128LOtoD64, data)));
-            hiOp = unop(Iop_D64toI64U, assignNew(bbOut, Ity_D64, unop(Iop_D128HItoD64, data)));
-            break;
-        default:
-          ppIRType(ty);
-          VG_(tool_panic)("objgrind:insert_store_checker");
-        }
 
-        eBiasLo64 = tyAddr==Ity_I32 ? mkU32(0) : mkU64(0);
-        addrLo64  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasLo64) );
-        dataLo64 = assignNew(bbOut, Ity_I64, loOp);
-        diLo64    = unsafeIRDirty_0_N(0,
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_2( addrLo64, dataLo64 )
-            );
-        eBiasHi64 = tyAddr==Ity_I32 ? mkU32(8) : mkU64(8);
-        addrHi64  = assignNew(bbOut, tyAddr, binop(mkAdd, addr, eBiasHi64) );
-        dataHi64 = assignNew(bbOut, Ity_I64, hiOp);
-        diHi64    = unsafeIRDirty_0_N(0,
-            hname, VG_(fnptr_to_fnentry)( helper ), 
-            mkIRExprVec_2( addrHi64, dataHi64 )
-            );
-        if (guard) diLo64->guard = guard;
-        if (guard) diHi64->guard = guard;
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diLo64));
-        addStmtToIRSB(bbOut, IRStmt_Dirty(diHi64));
-    }
-    else {
-        IRDirty *di;
-        IRAtom  *addrAct;
-
-        addrAct = addr;
-
-        if (ty == Ity_I64 || ty == Ity_F64 || ty == Ity_D64) {
-            IRAtom *d;
-
-            switch (ty) {
-            case Ity_I64:
-                d = data;
-                break;
-            case Ity_F64:
-                d = assignNew(bbOut, Ity_I64, unop(Iop_ReinterpF64asI64, data));
-                break;
-            case Ity_D64:
-                d = assignNew(bbOut, Ity_I64, unop(Iop_ReinterpD64asI64, data));
-                break;
-            default:
-                ppIRType(ty);
-                VG_(tool_panic)("objgrind:insert_store_checker");
-            }
-            
-          di = unsafeIRDirty_0_N(0,
-              hname, VG_(fnptr_to_fnentry)( helper ), 
-              mkIRExprVec_2( addrAct, d )
-              );
-        }
-        else {
-         di = unsafeIRDirty_0_N(0,
-                 hname, VG_(fnptr_to_fnentry)( helper ), 
-                 mkIRExprVec_2( addrAct,
-                                zwidenToHostWord( bbOut, tyAddr, data ))
-              );
-        }
-        if (guard) di->guard = guard;
-        addStmtToIRSB(bbOut, IRStmt_Dirty(di));
-    }
-}
+/*------------------------------------------------------------*/
+/*--- Turning checks on and off                            ---*/
+/*------------------------------------------------------------*/
 
-static
-IRSB* og_instrument ( VgCallbackClosure* closure,
+/* The START/STOP_CHECKING requests turn checking on and off for the
+   whole program, like Callgrind's START/STOP_INSTRUMENTATION: while
+   it's off og_instrument adds nothing, and every toggle throws away
+   the existing translations.  The shadow state is still kept up to
+   date by the other requests.  (--check-at-start says how to begin.)
+
+   The ENABLE/DISABLE_THREAD_CHECKING requests only affect the calling
+   thread, and only make the helpers return early: that is cheaper
+   than retranslating, and translations are shared by all threads. */
+
+Bool OG_(clo_check_at_start) = True;
+
+static Bool checking_on = True;
+
+static Bool thread_checking_off[VG_N_THREADS];
+
+/* thread_checking_off[] for the running thread, kept up to date by
+   og_start_client_code so that the helpers needn't find out which
+   thread they're in. */
+static Bool running_thread_checking_off = False;
+
+static void set_checking ( Bool on )
+{
+   if (on == checking_on)
+      return;
+   checking_on = on;
+   VG_(discard_translations)( (Addr64)0x1000, (ULong) ~0xfffl,
+                              "objgrind: set_checking" );
+}
+
+static void set_thread_checking ( ThreadId tid, Bool on )
+{
+   tl_assert(tid < VG_N_THREADS);
+   thread_checking_off[tid] = !on;
+   if (tid == VG_(get_running_tid)())
+      running_thread_checking_off = !on;
+}
+
+static void og_start_client_code ( ThreadId tid, ULong bbs_done )
+{
+   running_thread_checking_off = thread_checking_off[tid];
+}
+
+static void og_pre_thread_ll_exit ( ThreadId tid )
+{
+   thread_checking_off[tid] = False;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Event handlers called from generated code            ---*/
+/*------------------------------------------------------------*/
+
+/* There is one helper per store size.  Stores narrower than a host
+   word can't hold a reference, so their helpers only look for
+   UNWRITABLE granules and aren't passed the data.  Word-sized stores
+   also check the stored value when the destination is a refcheck
+   field; insert_store_checker picks the variant for the host word
+   size and the enabled checks, so nothing is decided at run time.
+   In the common case each helper fetches the destination secmap
+   once. */
+
+/* Nonzero iff any 2-bit field in 'abits' is A_BITS2_UNWRITABLE (01b). */
+static INLINE UWord any_unwritable ( UWord abits )
+{
+   return abits & ~(abits >> 1) & (UWord)0x5555555555555555ULL;
+}
+
+/* Helper calls by store size (1, 2, 4, 8, 16 and 32 bytes), how many
+   of them found the destination in a distinguished secmap, and how
+   many errors were passed to the core. */
+static ULong n_store_checks[6]    = { 0 };
+static ULong n_load_checks        = 0;
+static ULong n_range_checks       = 0;
+static ULong n_store_dsm_hits     = 0;
+static ULong n_error_record_calls = 0;
+
+/* Read abits8[0] and abits8[1] with one load, abits8[0] in the low
+   byte.  'p' must be 2-aligned. */
+static INLINE UWord get_abits16 ( const UChar* p )
+{
+   UWord w = *(const UShort*)p;
+#  if defined(VG_BIGENDIAN)
+   w = ((w & 0xff) << 8) | (w >> 8);
+#  endif
+   return w;
+}
+
+/* Fallback for get_store_abits: go granule by granule, possibly
+   across two secmaps. */
+static __attribute__((noinline))
+UWord get_store_abits_slow ( Addr a, SizeT szB )
+{
+   UWord first = a >> og_gran_shift;
+   UWord last  = (a + szB - 1) >> og_gran_shift;
+   UWord g, abits = 0;
+
+   for (g = first; g <= last; g++)
+      abits |= (UWord)get_abits2(g << og_gran_shift) << ((g - first) << 1);
+   return abits;
+}
+
+/* The states of the granules covering [a, a+szB), packed two bits
+   each with the granule containing 'a' in the low bits.  szB is at
+   most 8, so this is at most 16 bits. */
+static INLINE UWord get_store_abits ( Addr a, SizeT szB )
+{
+   UWord        first = a >> og_gran_shift;
+   UWord        last  = (a + szB - 1) >> og_gran_shift;
+   SecMap*      sm    = get_secmap_for_reading(a);
+   const UChar* p     = &sm->abits8[SM_OFF(a)];
+
+   n_store_dsm_hits += is_distinguished_sm(sm);
+   if (szB == 8 && og_gran_shift == 0 && VG_IS_8_ALIGNED(a)) {
+      // Aligned 8 bytes: exactly one aligned abits8 pair.
+      return get_abits16(p);
+   }
+   if (LIKELY((first >> 2) == (last >> 2))) {
+      // All granules are in the same abits8 byte.
+      return (*p >> ((first & 3) << 1))
+             & ((1 << ((last - first + 1) << 1)) - 1);
+   }
+   return get_store_abits_slow(a, szB);
+}
+
+/* These only fill in raw words; describing them is left to
+   og_tool_error_pp, which only runs for errors that get shown.
+
+   For a store of szB bytes at 'a', some of which are UNWRITABLE.  The
+   error is about the first of those, which needn't be at 'a'; the
+   helpers only know that one is there, so look for it here. */
+static __attribute__((noinline))
+void record_unwritable_error ( Addr a, SizeT szB, UWord data,
+                               Bool has_data )
+{
+   OgErrorExtra extra;
+   SizeT        i;
+
+   for (i = 0; i < szB - 1; i++)
+      if (get_abits2(a + i) == A_BITS2_UNWRITABLE)
+         break;
+   n_error_record_calls++;
+   extra.field       = a + i;
+   extra.value       = data;
+   extra.has_value   = has_data;
+   extra.field_state = A_BITS2_UNWRITABLE;
+   extra.value_state = has_data ? get_abits2(data) : A_BITS2_NOCHECK;
+   extra.origin      = NULL;
+   OG_(record_error)(UnwritableErr, a + i, &extra);
+}
+
+/* 'kind' is UnreferableErr for a store of 'data' to 'field', or
+   UnreferableLoadErr for a load of it from there. */
+static void get_unreferable_extra ( OgErrorExtra* extra,
+                                    Addr field, UWord data )
+{
+   n_error_record_calls++;
+   extra->field       = field;
+   extra->value       = data;
+   extra->has_value   = True;
+   extra->field_state = A_BITS2_REFCHECK;
+   extra->value_state = A_BITS2_UNREFERABLE;
+   if (OG_(clo_track_unreferable_origins))
+      get_unreferable_origin(data, extra);
+   else
+      extra->origin   = NULL;
+}
+
+static __attribute__((noinline))
+void record_unreferable_error ( OgErrorKind kind, Addr field, UWord data )
+{
+   OgErrorExtra extra;
+
+   get_unreferable_extra(&extra, field, data);
+   OG_(record_error)(kind, data, &extra);
+}
+
+static INLINE void store_check_nonword ( Addr a, SizeT szB )
+{
+   if (UNLIKELY(running_thread_checking_off))
+      return;
+   if (UNLIKELY(any_unwritable(get_store_abits(a, szB))))
+      record_unwritable_error(a, szB, 0, False);
+}
+
+/* 'abits2' is the state of the first granule of the word at 'field',
+   which is being overwritten with 'data'. */
+static INLINE void check_ref ( UWord abits2, Addr field, UWord data )
+{
+   if (UNLIKELY(abits2 == A_BITS2_REFCHECK)
+       && get_abits2(data) == A_BITS2_UNREFERABLE)
+      record_unreferable_error(UnreferableErr, field, data);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check8)(Addr a){
+    n_store_checks[0]++;
+    store_check_nonword(a, 1);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check16)(Addr a){
+    n_store_checks[1]++;
+    store_check_nonword(a, 2);
+}
+
+/* 4-byte store on a 64-bit host. */
+static VG_REGPARM(1) void
+OG_(store_check32)(Addr a){
+    n_store_checks[2]++;
+    store_check_nonword(a, 4);
+}
+
+/* 8-byte store with --check-refs=no, on any host. */
+static VG_REGPARM(1) void
+OG_(store_check64)(Addr a){
+    n_store_checks[3]++;
+    store_check_nonword(a, 8);
+}
+
+/* A store of the host word 'data'.  'unw' is False with
+   --check-unwritable=no. */
+static INLINE void store_check_word ( Addr a, SizeT szB, UWord data,
+                                      Bool unw )
+{
+    UWord abits;
+    if (UNLIKELY(running_thread_checking_off))
+        return;
+    abits = get_store_abits(a, szB);
+    if (unw && UNLIKELY(any_unwritable(abits)))
+        record_unwritable_error(a, szB, data, True);
+    else
+        check_ref(abits & 3, a, data);
+}
+
+/* An 8-byte store on a 32-bit host: two words, at a and a+4. */
+static INLINE void store_check_word2 ( Addr a, ULong data, Bool unw )
+{
+    UWord abits;
+    UInt  shift = (4 >> og_gran_shift) << 1;  // where a+4's state is
+    if (UNLIKELY(running_thread_checking_off))
+        return;
+    abits = get_store_abits(a, 8);
+    if (unw && UNLIKELY(any_unwritable(abits))) {
+        record_unwritable_error(a, 8, 0, False);
+        return;
+    }
+#   if defined(VG_BIGENDIAN)
+    check_ref(abits & 3, a, (UWord)(UInt)(data >> 32));
+    check_ref((abits >> shift) & 3, a + 4, (UWord)(UInt)data);
+#   else
+    check_ref(abits & 3, a, (UWord)(UInt)data);
+    check_ref((abits >> shift) & 3, a + 4, (UWord)(UInt)(data >> 32));
+#   endif
+}
+
+/* 4-byte store on a 32-bit host. */
+static VG_REGPARM(2) void
+OG_(store_check32w)(Addr a, UWord data){
+    n_store_checks[2]++;
+    store_check_word(a, 4, data, True);
+}
+
+/* 8-byte store on a 64-bit host. */
+static VG_REGPARM(1) void
+OG_(store_check64w)(Addr a, ULong data){
+    n_store_checks[3]++;
+    store_check_word(a, 8, (UWord)data, True);
+}
+
+/* 8-byte store on a 32-bit host. */
+static VG_REGPARM(1) void
+OG_(store_check64w2)(Addr a, ULong data){
+    n_store_checks[3]++;
+    store_check_word2(a, data, True);
+}
+
+/* The same three with --check-unwritable=no. */
+static VG_REGPARM(2) void
+OG_(store_check32r)(Addr a, UWord data){
+    n_store_checks[2]++;
+    store_check_word(a, 4, data, False);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check64r)(Addr a, ULong data){
+    n_store_checks[3]++;
+    store_check_word(a, 8, (UWord)data, False);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check64r2)(Addr a, ULong data){
+    n_store_checks[3]++;
+    store_check_word2(a, data, False);
+}
+
+/* Vector stores.  The shadow of a szB-aligned 16- or 32-byte store is
+   at most one aligned 64-bit chunk of abits8, so the common case is a
+   single read.  These helpers are called after the store has been
+   done: values only matter if the destination has refcheck fields,
+   and then they're read back from memory one word at a time rather
+   than being passed in. */
+
+static INLINE ULong any_unwritable64 ( ULong abits )
+{
+   return abits & ~(abits >> 1) & 0x5555555555555555ULL;
+}
+
+static INLINE ULong any_refcheck64 ( ULong abits )
+{
+   return abits & (abits >> 1) & 0x5555555555555555ULL;
+}
+
+#define VEC_UNWRITABLE  1   // some granule is UNWRITABLE
+#define VEC_REFCHECK    2   // some granule is REFCHECK
+#define VEC_SLOW        4   // the store crosses a secmap boundary
+
+static INLINE UWord vec_flags ( ULong abits )
+{
+   return (any_unwritable64(abits) != 0)
+          | ((any_refcheck64(abits) != 0) << 1);
+}
+
+/* Classify the states of the granules in [a, a+szB) with one secmap
+   fetch.  Other granules sharing the first and last abits8 bytes of
+   an unaligned store, or one whose size isn't a power of two, are
+   masked out. */
+static INLINE UWord get_vec_flags ( Addr a, SizeT szB )
+{
+   UWord        first = a >> og_gran_shift;
+   UWord        last  = (a + szB - 1) >> og_gran_shift;
+   UWord        n     = (last >> 2) - (first >> 2) + 1;  // abits8 bytes
+   UWord        i, flags;
+   SecMap*      sm;
+   const UChar* p;
+
+   if (UNLIKELY((a >> 16) != ((a + szB - 1) >> 16)))
+      return VEC_SLOW;
+   sm = get_secmap_for_reading(a);
+   p  = &sm->abits8[SM_OFF(a)];
+   n_store_dsm_hits += is_distinguished_sm(sm);
+   if (LIKELY((szB & (szB - 1)) == 0 && (a & (szB - 1)) == 0)) {
+      switch (n) {
+         case 8: return vec_flags(*(const ULong*) p);
+         case 4: return vec_flags(*(const UInt*)  p);
+         case 2: return vec_flags(*(const UShort*)p);
+         default: break;
+      }
+   }
+   flags = 0;
+   for (i = 0; i < n; i++) {
+      UWord abits8 = p[i];
+      if (i == 0)
+         abits8 &= 0xff << ((first & 3) << 1);
+      if (i == n - 1)
+         abits8 &= 0xff >> ((3 - (last & 3)) << 1);
+      flags |= vec_flags(abits8);
+   }
+   return flags;
+}
+
+/* Slow path: some granule is REFCHECK, or the store crosses a secmap.
+   Check each host word the store wrote.  'unw' and 'refs' say which
+   checks are enabled. */
+static __attribute__((noinline))
+void store_check_vec_slow ( Addr a, SizeT szB, Bool unw, Bool refs )
+{
+   SizeT i;
+   UWord data;
+
+   for (i = 0; unw && i < szB; i++) {
+      if (get_abits2(a + i) == A_BITS2_UNWRITABLE) {
+         record_unwritable_error(a + i, 1, 0, False);
+         return;
+      }
+   }
+   for (i = 0; refs && i < szB; i += sizeof(UWord)) {
+      if (get_abits2(a + i) != A_BITS2_REFCHECK)
+         continue;
+      VG_(memcpy)(&data, (void*)(a + i), sizeof(data));
+      check_ref(A_BITS2_REFCHECK, a + i, data);
+   }
+}
+
+static INLINE void store_check_vec ( Addr a, SizeT szB,
+                                     Bool unw, Bool refs )
+{
+   UWord flags;
+
+   if (UNLIKELY(running_thread_checking_off))
+      return;
+   flags = get_vec_flags(a, szB);
+   if (!unw)
+      flags &= ~VEC_UNWRITABLE;
+   if (!refs)
+      flags &= ~VEC_REFCHECK;
+   if (LIKELY(flags == 0))
+      return;
+   if (flags & VEC_UNWRITABLE)
+      record_unwritable_error(a, szB, 0, False);
+   else
+      store_check_vec_slow(a, szB, unw, refs);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check128)(Addr a){
+    n_store_checks[4]++;
+    store_check_vec(a, 16, True, True);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check256)(Addr a){
+    n_store_checks[5]++;
+    store_check_vec(a, 32, True, True);
+}
+
+/* With --check-refs=no ('u') or --check-unwritable=no ('r').  The 'u'
+   variants never read memory, so they may be called before the store. */
+static VG_REGPARM(1) void
+OG_(store_check128u)(Addr a){
+    n_store_checks[4]++;
+    store_check_vec(a, 16, True, False);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check256u)(Addr a){
+    n_store_checks[5]++;
+    store_check_vec(a, 32, True, False);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check128r)(Addr a){
+    n_store_checks[4]++;
+    store_check_vec(a, 16, False, True);
+}
+
+static VG_REGPARM(1) void
+OG_(store_check256r)(Addr a){
+    n_store_checks[5]++;
+    store_check_vec(a, 32, False, True);
+}
+
+/* A group of adjacent stores coalesced by scan_superblock, covering
+   [a, a+len) with no gaps; len is at most MAX_GROUP_SPAN.  Called
+   after the last store, so the values are read back from memory, and
+   only for REFCHECK granules.  Unlike the per-store helpers this
+   reports the first unwritable granule, once for the whole group. */
+static __attribute__((noinline))
+void store_check_range_slow ( Addr a, SizeT len )
+{
+   UWord gran = 1UL << og_gran_shift;
+   Addr  end  = a + len;
+   Addr  p;
+   UWord data;
+
+   for (p = a; p < end; p++) {
+      if (get_abits2(p) == A_BITS2_UNWRITABLE) {
+         record_unwritable_error(p, 1, 0, False);
+         return;
+      }
+   }
+   for (p = VG_ROUNDUP(a, gran); p + sizeof(UWord) <= end; p += gran) {
+      if (get_abits2(p) != A_BITS2_REFCHECK)
+         continue;
+      VG_(memcpy)(&data, (void*)p, sizeof(data));
+      check_ref(A_BITS2_REFCHECK, p, data);
+   }
+}
+
+static VG_REGPARM(2) void
+OG_(store_check_range)(Addr a, UWord len){
+    n_range_checks++;
+    if (UNLIKELY(running_thread_checking_off))
+        return;
+    if (UNLIKELY(get_vec_flags(a, len) != 0))
+        store_check_range_slow(a, len);
+}
+
+/* With --check-loads=yes, word loads are checked too, so that a stale
+   reference is caught when it is read and not only when its field is
+   next written.  Called after the load, with the value loaded. */
+Bool OG_(clo_check_loads) = False;
+
+static VG_REGPARM(2) void
+OG_(load_check)(Addr a, UWord data){
+    n_load_checks++;
+    if (UNLIKELY(running_thread_checking_off))
+        return;
+    if (UNLIKELY(get_abits2(a) == A_BITS2_REFCHECK)
+        && get_abits2(data) == A_BITS2_UNREFERABLE)
+        record_unreferable_error(UnreferableLoadErr, a, data);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Instrumentation scope                                ---*/
+/*------------------------------------------------------------*/
+
+/* --instrument-objs, --ignore-objs, --instrument-fns and --ignore-fns
+   select the code that gets instrumented at all; stores and loads
+   anywhere else get no helper calls.  --collector-fns names the
+   collector's own functions, which legitimately write UNWRITABLE
+   objects and read dangling references while sweeping: their stores
+   are only checked for refs.  Each option takes a comma-separated
+   list of patterns, with '*' and '?' wildcards, and may be given more
+   than once.  An object pattern matches either the full path or the
+   file name.
+
+   All this is decided per guest instruction, from its IMark, when a
+   superblock is translated, so it costs nothing afterwards. */
+
+static XArray* instrument_objs = NULL;   /* of HChar* */
+static XArray* ignore_objs     = NULL;
+static XArray* instrument_fns  = NULL;
+static XArray* ignore_fns      = NULL;
+static XArray* collector_fns   = NULL;
+
+/* True iff any of the above was given. */
+static Bool scope_given = False;
+
+/* Guest instructions translated outside the scope, and inside
+   collector functions. */
+static ULong n_insns_skipped   = 0;
+static ULong n_insns_collector = 0;
+
+typedef
+   enum {
+      Scope_Skip,        // no checks at all
+      Scope_Collector,   // ref checks on stores only
+      Scope_Check        // everything enabled
+   }
+   InsnScope;
+
+static void add_scope_patterns ( XArray** xa, const HChar* list )
+{
+   HChar* copy = VG_(strdup)("og.scope.patterns", list);
+   HChar* save = NULL;
+   HChar* pat;
+
+   if (*xa == NULL)
+      *xa = VG_(newXA)(VG_(malloc), "og.scope", VG_(free), sizeof(HChar*));
+   // The patterns point into 'copy', which is kept for good.
+   for (pat = VG_(strtok_r)(copy, ",", &save); pat != NULL;
+        pat = VG_(strtok_r)(NULL, ",", &save))
+      VG_(addToXA)(*xa, &pat);
+   scope_given = True;
+}
+
+static Bool matches_any ( XArray* xa, const HChar* name )
+{
+   Word i;
+
+   for (i = 0; i < VG_(sizeXA)(xa); i++) {
+      if (VG_(string_match)(*(HChar**)VG_(indexXA)(xa, i), name))
+         return True;
+   }
+   return False;
+}
+
+static Bool obj_matches_any ( XArray* xa, const HChar* path )
+{
+   const HChar* file = VG_(strrchr)(path, '/');
+
+   return matches_any(xa, path) || (file && matches_any(xa, file + 1));
+}
+
+/* Code with no debug info only passes an --instrument-* list if it
+   is empty. */
+static InsnScope get_insn_scope ( Addr a )
+{
+   HChar obj[256], fn[256];
+   Bool  has_obj = VG_(get_objname)(a, obj, sizeof(obj));
+   Bool  has_fn  = VG_(get_fnname)(a, fn, sizeof(fn));
+
+   if (instrument_objs && !(has_obj && obj_matches_any(instrument_objs, obj)))
+      return Scope_Skip;
+   if (ignore_objs && has_obj && obj_matches_any(ignore_objs, obj))
+      return Scope_Skip;
+   if (instrument_fns && !(has_fn && matches_any(instrument_fns, fn)))
+      return Scope_Skip;
+   if (ignore_fns && has_fn && matches_any(ignore_fns, fn))
+      return Scope_Skip;
+   if (collector_fns && has_fn && matches_any(collector_fns, fn))
+      return Scope_Collector;
+   return Scope_Check;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Instrument                                           ---*/
+/*------------------------------------------------------------*/
+
+typedef  IRExpr  IRAtom;
+
+/* build various kinds of expressions */
+#define triop(_op, _arg1, _arg2, _arg3) \
+                                 IRExpr_Triop((_op),(_arg1),(_arg2),(_arg3))
+#define binop(_op, _arg1, _arg2) IRExpr_Binop((_op),(_arg1),(_arg2))
+#define unop(_op, _arg)          IRExpr_Unop((_op),(_arg))
+#define mkU1(_n)                 IRExpr_Const(IRConst_U1(_n))
+#define mkU8(_n)                 IRExpr_Const(IRConst_U8(_n))
+#define mkU16(_n)                IRExpr_Const(IRConst_U16(_n))
+#define mkU32(_n)                IRExpr_Const(IRConst_U32(_n))
+#define mkU64(_n)                IRExpr_Const(IRConst_U64(_n))
+#define mkV128(_n)               IRExpr_Const(IRConst_V128(_n))
+#define mkexpr(_tmp)             IRExpr_RdTmp((_tmp))
+
+static IRAtom* assignNew ( IRSB* bbOut, IRType ty, IRExpr* e )
+{
+   IRTemp   t;
+
+   t = newIRTemp(bbOut->tyenv, ty);
+   addStmtToIRSB(bbOut, IRStmt_WrTmp(t, e));
+   return IRExpr_RdTmp(t);
+}
+
+static IRAtom* zwidenToHostWord (IRSB* bbOut, IRType tyH, IRAtom* atom)
+{
+   IRType ty;
+
+   ty  = typeOfIRExpr(bbOut->tyenv, atom);
+
+   if (tyH == Ity_I32) {
+      switch (ty) {
+         case Ity_F32:
+            return assignNew(bbOut, tyH, unop(Iop_ReinterpF32asI32, atom));
+         case Ity_D32:
+             return assignNew(bbOut, tyH, unop(Iop_64to32,
+                    unop(Iop_ReinterpD64asI64, unop(Iop_D32toD64, atom))));
+         case Ity_I32:
+            return atom;
+         case Ity_I16:
+            return assignNew(bbOut, tyH, unop(Iop_16Uto32, atom));
+         case Ity_I8:
+            return assignNew(bbOut, tyH, unop(Iop_8Uto32, atom));
+         default:
+            goto unhandled;
+      }
+   } else
+   if (tyH == Ity_I64) {
+      switch (ty) {
+         case Ity_F32:
+            return assignNew(bbOut, tyH, unop(Iop_32Uto64,
+                   assignNew(bbOut, Ity_I32, unop(Iop_ReinterpF32asI32, atom))));
+         case Ity_D32:
+            return assignNew(bbOut, tyH, unop(Iop_ReinterpD64asI64,
+                   assignNew(bbOut, Ity_D64, unop(Iop_D32toD64, atom))));
+         case Ity_I32:
+            return assignNew(bbOut, tyH, unop(Iop_32Uto64, atom));
+         case Ity_I16:
+            return assignNew(bbOut, tyH, unop(Iop_32Uto64, 
+                   assignNew(bbOut, Ity_I32, unop(Iop_16Uto32, atom))));
+         case Ity_I8:
+            return assignNew(bbOut, tyH, unop(Iop_32Uto64, 
+                   assignNew(bbOut, Ity_I32, unop(Iop_8Uto32, atom))));
+         default:
+            goto unhandled;
+      }
+   } else {
+      goto unhandled;
+   }
+  unhandled:
+   VG_(printf)("\nty = "); ppIRType(ty); VG_(printf)("\n");
+   VG_(tool_panic)("zwidenToHostWord");
+}
+
+#if defined(VG_BIGENDIAN)
+#  define Iend_HOST Iend_BE
+#else
+#  define Iend_HOST Iend_LE
+#endif
+
+static IRAtom* mkHostWord ( IRType tyH, Addr w )
+{
+   return tyH == Ity_I32 ? mkU32((UInt)w) : mkU64((ULong)w);
+}
+
+/* Combine two Ity_I1 atoms.  VEX has no 1-bit logic ops, so go via
+   32 bits.  A NULL operand means "always true". */
+static IRAtom* mk1op ( IRSB* bbOut, IROp op32, IRAtom* g1, IRAtom* g2 )
+{
+   return assignNew(bbOut, Ity_I1, binop(Iop_CmpNE32,
+                    assignNew(bbOut, Ity_I32, binop(op32,
+                       assignNew(bbOut, Ity_I32, unop(Iop_1Uto32, g1)),
+                       assignNew(bbOut, Ity_I32, unop(Iop_1Uto32, g2)))),
+                    mkU32(0)));
+}
+
+static IRAtom* mkOr1 ( IRSB* bbOut, IRAtom* g1, IRAtom* g2 )
+{
+   return mk1op(bbOut, Iop_Or32, g1, g2);
+}
+
+static IRAtom* mkAnd1 ( IRSB* bbOut, IRAtom* g1, IRAtom* g2 )
+{
+   if (g1 == NULL) return g2;
+   if (g2 == NULL) return g1;
+   return mk1op(bbOut, Iop_And32, g1, g2);
+}
+
+/* Generate tyH:LOAD(table + ((addr >> shift) & mask) * sizeof(word)). */
+static IRAtom* gen_table_load ( IRSB* bbOut, IRType tyH, IRAtom* table,
+                                IRAtom* addr, UInt shift, UWord mask )
+{
+   IROp    opShr = tyH == Ity_I32 ? Iop_Shr32   : Iop_Shr64;
+   IROp    opShl = tyH == Ity_I32 ? Iop_Shl32   : Iop_Shl64;
+   IROp    opAnd = tyH == Ity_I32 ? Iop_And32   : Iop_And64;
+   IROp    opAdd = tyH == Ity_I32 ? Iop_Add32   : Iop_Add64;
+   IRAtom *idx, *ent;
+
+   idx = assignNew(bbOut, tyH, binop(opShr, addr, mkU8(shift)));
+   idx = assignNew(bbOut, tyH, binop(opAnd, idx, mkHostWord(tyH, mask)));
+   idx = assignNew(bbOut, tyH, binop(opShl, idx,
+                                     mkU8(tyH == Ity_I32 ? 2 : 3)));
+   ent = assignNew(bbOut, tyH, binop(opAdd, table, idx));
+   return assignNew(bbOut, tyH, IRExpr_Load(Iend_HOST, tyH, ent));
+}
+
+/* Generate an Ity_I1 atom which is true iff the secmap covering
+   'addr' is anything other than the distinguished NOCHECK map, i.e.
+   iff the store might need checking.  On 64-bit hosts both the
+   primary map and the radix tree are looked up and the right result
+   picked afterwards.  The primary map index is masked so that load
+   stays inside primary_map[]; the radix tree has no holes, so its
+   loads are always safe. */
+static IRAtom* gen_maybe_checked_guard ( IRSB* bbOut, IRType tyH,
+                                         IRAtom* addr )
+{
+   IROp    opCmp = tyH == Ity_I32 ? Iop_CmpNE32 : Iop_CmpNE64;
+   IRAtom *sm, *l2, *l3, *sm_high, *high;
+
+   sm = gen_table_load(bbOut, tyH, mkHostWord(tyH, (Addr)&primary_map[0]),
+                       addr, 16, N_PRIMARY_MAP-1);
+   if (tyH == Ity_I64) {
+      l2      = gen_table_load(bbOut, tyH, mkU64((Addr)&radix_l1[0]),
+                               addr, 48, RADIX_MASK);
+      l3      = gen_table_load(bbOut, tyH, l2, addr, 32, RADIX_MASK);
+      sm_high = gen_table_load(bbOut, tyH, l3, addr, 16, RADIX_MASK);
+      high    = assignNew(bbOut, Ity_I1, binop(Iop_CmpLT64U,
+                                       mkU64(MAX_PRIMARY_ADDRESS), addr));
+      sm      = assignNew(bbOut, tyH, IRExpr_ITE(high, sm_high, sm));
+   }
+   return assignNew(bbOut, Ity_I1, binop(opCmp, sm,
+                    mkHostWord(tyH, (Addr)&sm_distinguished[SM_DIST_NOCHECK])));
+}
+
+/* Guard for a store (or a checked load) of szB bytes at 'addr'.  The
+   access may straddle two secmaps, so for wide ones the last byte is
+   checked too. */
+static IRAtom* gen_store_guard ( IRSB* bbOut, IRType tyH, IRAtom* addr,
+                                 Int szB, IRAtom* guard )
+{
+   IRAtom* g = gen_maybe_checked_guard(bbOut, tyH, addr);
+   if (szB > 1) {
+      IRAtom* last = assignNew(bbOut, tyH,
+                               binop(tyH == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                                     addr, mkHostWord(tyH, szB-1)));
+      IRAtom* g2   = gen_maybe_checked_guard(bbOut, tyH, last);
+      g = mkOr1(bbOut, g, g2);
+   }
+   return mkAnd1(bbOut, guard, g);
+}
+
+/* Which checks stores get (--check-unwritable, --check-refs).  Each
+   combination has its own helpers, so turning one off shrinks the
+   generated code rather than adding a test to every call.  The
+   instrumentation scope can turn them off for particular code too. */
+Bool OG_(clo_check_unwritable) = True;
+Bool OG_(clo_check_refs)       = True;
+
+/* Emit a call to the helper for a szB-byte store at addr.  For
+   stores the size of a host word (or two, for 8-byte stores on 32-bit
+   hosts) 'data' is the value stored, as an Ity_I64 for 8-byte stores
+   and a host word otherwise; for other sizes, and without 'refs',
+   it's ignored.  16- and 32-byte calls must come after the store
+   itself if refs are checked.  'unw' and 'refs' say which checks to
+   make. */
+static void gen_store_check_call ( IRSB* bbOut, IRType tyAddr, IRAtom* addr,
+                                   Int szB, IRAtom* data, IRAtom* guard,
+                                   Bool unw, Bool refs )
+{
+    void*        helper;
+    const HChar* hname;
+    Int          regparms;
+    IRExpr**     args;
+    IRDirty*     di;
+
+#   define SET_HELPER(_fn) \
+       do { helper = &OG_(_fn); hname = "OG_(" #_fn ")"; } while (0)
+
+    tl_assert(unw || refs);
+    switch (szB) {
+    case 1:
+        SET_HELPER(store_check8);
+        regparms = 1;
+        args = mkIRExprVec_1(addr);
+        break;
+    case 2:
+        SET_HELPER(store_check16);
+        regparms = 1;
+        args = mkIRExprVec_1(addr);
+        break;
+    case 4:
+        if (tyAddr == Ity_I32 && refs) {
+            if (unw) SET_HELPER(store_check32w);
+            else     SET_HELPER(store_check32r);
+            regparms = 2;
+            args = mkIRExprVec_2(addr, data);
+        } else {
+            SET_HELPER(store_check32);
+            regparms = 1;
+            args = mkIRExprVec_1(addr);
+        }
+        break;
+    case 8:
+        regparms = 1;
+        if (!refs) {
+            SET_HELPER(store_check64);
+            args = mkIRExprVec_1(addr);
+            break;
+        }
+        if (tyAddr == Ity_I32) {
+            if (unw) SET_HELPER(store_check64w2);
+            else     SET_HELPER(store_check64r2);
+        } else {
+            if (unw) SET_HELPER(store_check64w);
+            else     SET_HELPER(store_check64r);
+        }
+        args = mkIRExprVec_2(addr, data);
+        break;
+    case 16:
+        if (!refs)     SET_HELPER(store_check128u);
+        else if (!unw) SET_HELPER(store_check128r);
+        else           SET_HELPER(store_check128);
+        regparms = 1;
+        args = mkIRExprVec_1(addr);
+        break;
+    case 32:
+        if (!refs)     SET_HELPER(store_check256u);
+        else if (!unw) SET_HELPER(store_check256r);
+        else           SET_HELPER(store_check256);
+        regparms = 1;
+        args = mkIRExprVec_1(addr);
+        break;
+    default:
+        VG_(tool_panic)("objgrind:gen_store_check_call");
+    }
+#   undef SET_HELPER
+
+    di = unsafeIRDirty_0_N(regparms, hname,
+                           VG_(fnptr_to_fnentry)( helper ), args);
+    if (szB >= 16 && refs) {
+        /* The vector helpers may read back what was stored. */
+        di->mFx   = Ifx_Read;
+        di->mAddr = addr;
+        di->mSize = szB;
+    }
+    if (guard) di->guard = guard;
+    addStmtToIRSB(bbOut, IRStmt_Dirty(di));
+}
+
+/* Instrument the store 'st' of 'data' to 'addr' and add it to bbOut.
+   'unw' and 'refs' are as for gen_store_check_call. */
+static void
+insert_store_checker(IRSB* bbOut, IRStmt* st, IRAtom* addr, IRAtom* data,
+                     IRAtom* guard, IRType tyAddr, Bool unw, Bool refs)
+{
+    IRType   ty;
+    Int      szB;
+    IRAtom*  d = NULL;
+
+    tl_assert(tyAddr == Ity_I32 || tyAddr == Ity_I64);
+
+    ty  = typeOfIRExpr(bbOut->tyenv, data);
+    szB = sizeofIRType(ty);
+
+    /* Stores narrower than a host word can't hold a reference, so
+       without 'unw' there is nothing to check. */
+    if (!unw && (!refs || szB < sizeofIRType(tyAddr))) {
+        addStmtToIRSB(bbOut, st);
+        return;
+    }
+
+    /* Skip the helper call entirely for stores into NOCHECK secmaps. */
+    guard = gen_store_guard(bbOut, tyAddr, addr, szB, guard);
+
+    /* Without 'refs' the data is never looked at, so it needn't be
+       widened, and the check can go before any store. */
+    if (!refs) {
+        gen_store_check_call(bbOut, tyAddr, addr, szB, NULL, guard,
+                             unw, refs);
+        addStmtToIRSB(bbOut, st);
+        return;
+    }
+
+    switch (ty) {
+    case Ity_V256:
+    case Ity_V128:
+    case Ity_I128:
+    case Ity_F128:
+    case Ity_D128:
+        /* One call for the whole store, made once it has happened;
+           see store_check_vec. */
+        addStmtToIRSB(bbOut, st);
+        gen_store_check_call(bbOut, tyAddr, addr, szB, NULL, guard,
+                             unw, refs);
+        return;
+    case Ity_I64:
+        d = data;
+        break;
+    case Ity_F64:
+        d = assignNew(bbOut, Ity_I64, unop(Iop_ReinterpF64asI64, data));
+        break;
+    case Ity_D64:
+        d = assignNew(bbOut, Ity_I64, unop(Iop_ReinterpD64asI64, data));
+        break;
+    case Ity_F32:
+    case Ity_D32:
+    case Ity_I32:
+        /* Only a word on 32-bit hosts. */
+        if (tyAddr == Ity_I32)
+            d = zwidenToHostWord(bbOut, tyAddr, data);
+        break;
+    case Ity_I16:
+    case Ity_I8:
+        break;
+    default:
+        VG_(printf)("\nty = "); ppIRType(ty); VG_(printf)("\n");
+        VG_(tool_panic)("objgrind:insert_store_checker");
+    }
+    gen_store_check_call(bbOut, tyAddr, addr, szB, d, guard, unw, refs);
+    addStmtToIRSB(bbOut, st);
+}
+
+/* Add a check of the load of host word 'data' from 'addr', which must
+   already be in bbOut.  Narrower loads can't hold a reference and
+   aren't checked. */
+static void
+insert_load_checker(IRSB* bbOut, IRAtom* addr, IRAtom* data,
+                    IRAtom* guard, IRType tyAddr)
+{
+    IRDirty* di;
+
+    if (typeOfIRExpr(bbOut->tyenv, data) != tyAddr)
+        return;
+    di = unsafeIRDirty_0_N(2, "OG_(load_check)",
+                           VG_(fnptr_to_fnentry)( &OG_(load_check) ),
+                           mkIRExprVec_2(addr, data));
+    di->guard = gen_store_guard(bbOut, tyAddr, addr, sizeofIRType(tyAddr),
+                                guard);
+    addStmtToIRSB(bbOut, IRStmt_Dirty(di));
+}
+
+/* Object initialisation writes a run of fields off one pointer:
+   [t+0], [t+8], [t+16] and so on.  Rather than calling a helper for
+   each of those stores, scan_superblock finds runs of plain stores
+   which
+      - are to the same base temp plus constant offsets,
+      - together cover a single range of at most MAX_GROUP_SPAN bytes
+        with no gaps or overlaps, and
+      - have no other store, exit or call between them,
+   and og_instrument checks each such group with one call to
+   store_check_range after its last store.  Errors in a group are
+   reported at that store, and an unwritable group is one error however
+   many of its stores hit unwritable memory.  Since that changes where
+   and how often errors are reported, groups are only formed with
+   --coalesce-stores=yes, and only where both checks are enabled. */
+
+Bool OG_(clo_coalesce_stores) = False;
+
+#define MAX_GROUP_SPAN 64
+
+/* Stores coalesced, and the groups they went into, counted at
+   translation time. */
+static ULong n_grouped_stores = 0;
+static ULong n_store_groups   = 0;
+
+/* With --ignore-stack-stores=yes, stores whose address is the guest
+   SP plus or minus a constant (possibly rounded down by an And) aren't
+   checked: the runtime never puts objects on the machine stack, and
+   spills, pushes and locals are a large share of all stores. */
+Bool OG_(clo_ignore_stack_stores) = False;
+
+static ULong n_stack_stores = 0;
+
+/* What the first pass over a superblock found out about each
+   statement. */
+typedef
+   struct {
+      UChar  scope;     // for IMarks: the InsnScope of the instruction
+      Bool   stack;     // for stores: to the stack, not checked
+      Bool   grouped;   // for stores: checked as part of a group...
+      Bool   last;      // ...after this store
+      IRTemp base;      // for 'last': the group covers
+      Long   lo, hi;    //    [base+lo, base+hi)
+   }
+   StmtInfo;
+
+typedef
+   struct {
+      Int    first, last, n;
+      IRTemp base;
+      Long   lo, hi;
+   }
+   StoreGroup;
+
+/* Addresses computed as base temp plus constant, indexed by temp.
+   bases[t] is IRTemp_INVALID for other temps. */
+static void note_base_and_offset ( IRStmt* st, IRTemp* bases, Long* offs )
+{
+   IRExpr*  e = st->Ist.WrTmp.data;
+   IRExpr  *a1, *a2;
+   IRConst* c;
+   IRTemp   t;
+   Long     k;
+
+   if (e->tag != Iex_Binop)
+      return;
+   a1 = e->Iex.Binop.arg1;
+   a2 = e->Iex.Binop.arg2;
+   switch (e->Iex.Binop.op) {
+      case Iop_Add32: case Iop_Add64:
+         if (a1->tag == Iex_Const) { IRExpr* tmp = a1; a1 = a2; a2 = tmp; }
+         /* fallthrough */
+      case Iop_Sub32: case Iop_Sub64:
+         if (a1->tag != Iex_RdTmp || a2->tag != Iex_Const)
+            return;
+         break;
+      default:
+         return;
+   }
+   c = a2->Iex.Const.con;
+   switch (c->tag) {
+      case Ico_U32: k = (Long)(Int)c->Ico.U32; break;
+      case Ico_U64: k = (Long)c->Ico.U64;      break;
+      default:      return;
+   }
+   if (e->Iex.Binop.op == Iop_Sub32 || e->Iex.Binop.op == Iop_Sub64)
+      k = -k;
+   t = a1->Iex.RdTmp.tmp;
+   if (bases[t] != IRTemp_INVALID) {
+      k += offs[t];
+      t  = bases[t];
+   }
+   bases[st->Ist.WrTmp.tmp] = t;
+   offs[st->Ist.WrTmp.tmp]  = k;
+}
+
+/* A store which may go in a group: an unguarded, host-endian store
+   of up to 8 bytes, to a temp. */
+static Bool is_groupable_store ( IRSB* bb, IRStmt* st, IRTemp* bases,
+                                 Long* offs, IRTemp* base, Long* off,
+                                 Int* szB )
+{
+   IRExpr* addr = st->Ist.Store.addr;
+   IRTemp  t;
+
+   if (st->Ist.Store.end != Iend_HOST || addr->tag != Iex_RdTmp)
+      return False;
+   switch (typeOfIRExpr(bb->tyenv, st->Ist.Store.data)) {
+      case Ity_I8: case Ity_I16: case Ity_I32: case Ity_I64:
+      case Ity_F32: case Ity_F64: case Ity_D32: case Ity_D64:
+         break;
+      default:
+         return False;
+   }
+   t = addr->Iex.RdTmp.tmp;
+   *base = bases[t] != IRTemp_INVALID ? bases[t] : t;
+   *off  = bases[t] != IRTemp_INVALID ? offs[t]  : 0;
+   *szB  = sizeofIRType(typeOfIRExpr(bb->tyenv, st->Ist.Store.data));
+   return True;
+}
+
+static void close_store_group ( IRSB* bb, StmtInfo* info, StoreGroup* g )
+{
+   Int i;
+
+   if (g->n >= 2) {
+      // Every store from first to last is in the group.
+      for (i = g->first; i <= g->last; i++)
+         info[i].grouped = bb->stmts[i]->tag == Ist_Store;
+      info[g->last].last = True;
+      info[g->last].base = g->base;
+      info[g->last].lo   = g->lo;
+      info[g->last].hi   = g->hi;
+      n_grouped_stores += g->n;
+      n_store_groups++;
+   }
+   g->n = 0;
+}
+
+/* Note temps holding the guest SP, or an address derived from it. */
+static void note_stack_temp ( IRStmt* st, IRTemp* bases, Bool* from_sp,
+                              Int offset_SP, IRType tyH )
+{
+   IRExpr* e = st->Ist.WrTmp.data;
+   IRTemp  t = st->Ist.WrTmp.tmp;
+   IRTemp  a;
+
+   if (e->tag == Iex_Get) {
+      from_sp[t] = e->Iex.Get.offset == offset_SP && e->Iex.Get.ty == tyH;
+   } else if (e->tag == Iex_Binop
+              && (e->Iex.Binop.op == Iop_And32 || e->Iex.Binop.op == Iop_And64)
+              && e->Iex.Binop.arg1->tag == Iex_RdTmp
+              && e->Iex.Binop.arg2->tag == Iex_Const) {
+      a = e->Iex.Binop.arg1->Iex.RdTmp.tmp;
+      from_sp[t] = from_sp[bases[a] != IRTemp_INVALID ? bases[a] : a];
+   }
+}
+
+static Bool is_stack_addr ( IRExpr* addr, IRTemp* bases, Bool* from_sp )
+{
+   IRTemp t;
+
+   if (addr->tag != Iex_RdTmp)
+      return False;
+   t = addr->Iex.RdTmp.tmp;
+   return from_sp[bases[t] != IRTemp_INVALID ? bases[t] : t];
+}
+
+/* The first pass: look up the scope of each instruction, find the
+   stores to the stack and the groups of stores to coalesce. */
+static void scan_superblock ( IRSB* bb, StmtInfo* info, Int offset_SP,
+                              IRType tyH )
+{
+   Int        n_temps = bb->tyenv->types_used;
+   IRTemp*    bases   = VG_(malloc)("og.groups.bases",
+                                    (n_temps + 1) * sizeof(IRTemp));
+   Long*      offs    = VG_(malloc)("og.groups.offs",
+                                    (n_temps + 1) * sizeof(Long));
+   Bool*      from_sp = VG_(calloc)("og.groups.from_sp",
+                                    n_temps + 1, sizeof(Bool));
+   Bool       stack   = OG_(clo_ignore_stack_stores);
+   Bool       both    = OG_(clo_check_unwritable) && OG_(clo_check_refs);
+   Bool       group   = OG_(clo_coalesce_stores) && both;
+   StoreGroup g;
+   IRTemp     base;
+   Long       off;
+   Int        i, szB;
+
+   for (i = 0; i < n_temps; i++)
+      bases[i] = IRTemp_INVALID;
+   g.n = 0;
+   for (i = 0; i < bb->stmts_used; i++) {
+      IRStmt* st = bb->stmts[i];
+
+      switch (st->tag) {
+      case Ist_IMark:
+         if (scope_given) {
+            InsnScope scope = get_insn_scope(st->Ist.IMark.addr);
+            info[i].scope = scope;
+            n_insns_skipped   += scope == Scope_Skip;
+            n_insns_collector += scope == Scope_Collector;
+            group = OG_(clo_coalesce_stores) && both && scope == Scope_Check;
+            if (!group)
+               close_store_group(bb, info, &g);
+         }
+         break;
+      case Ist_WrTmp:
+         note_base_and_offset(st, bases, offs);
+         if (stack)
+            note_stack_temp(st, bases, from_sp, offset_SP, tyH);
+         break;
+      case Ist_NoOp:
+      case Ist_AbiHint:
+      case Ist_Put:
+      case Ist_PutI:
+      case Ist_LoadG:
+         break;
+      case Ist_StoreG:
+         if (stack && is_stack_addr(st->Ist.StoreG.details->addr,
+                                    bases, from_sp)) {
+            info[i].stack = True;
+            n_stack_stores++;
+         }
+         close_store_group(bb, info, &g);
+         break;
+      case Ist_Store:
+         if (stack && is_stack_addr(st->Ist.Store.addr, bases, from_sp)) {
+            // Can't overlap a group, so needn't end one.
+            info[i].stack = True;
+            n_stack_stores++;
+            break;
+         }
+         if (group && is_groupable_store(bb, st, bases, offs,
+                                         &base, &off, &szB)) {
+            // Only a store just above or below the group extends it.
+            // One overlapping it would hide the store it overwrote,
+            // since the group is checked from memory afterwards.
+            if (g.n > 0 && base == g.base
+                && (off == g.hi || off + szB == g.lo)
+                && g.hi - g.lo + szB <= MAX_GROUP_SPAN) {
+               if (off < g.lo)       g.lo = off;
+               if (off + szB > g.hi) g.hi = off + szB;
+               g.last = i;
+               g.n++;
+               break;
+            }
+            close_store_group(bb, info, &g);
+            g.first = g.last = i;
+            g.n     = 1;
+            g.base  = base;
+            g.lo    = off;
+            g.hi    = off + szB;
+            break;
+         }
+         close_store_group(bb, info, &g);
+         break;
+      default:
+         close_store_group(bb, info, &g);
+         break;
+      }
+   }
+   close_store_group(bb, info, &g);
+   VG_(free)(bases);
+   VG_(free)(offs);
+   VG_(free)(from_sp);
+}
+
+/* Check the group of stores covering [base+lo, base+hi). */
+static void gen_store_range_check ( IRSB* bbOut, IRType tyAddr,
+                                    IRTemp base, Long lo, Long hi )
+{
+   IRAtom*  addr = mkexpr(base);
+   Int      len  = (Int)(hi - lo);
+   IRDirty* di;
+
+   if (lo != 0)
+      addr = assignNew(bbOut, tyAddr,
+                       binop(tyAddr == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                             addr, mkHostWord(tyAddr, (Addr)lo)));
+   di = unsafeIRDirty_0_N(2, "OG_(store_check_range)",
+                          VG_(fnptr_to_fnentry)( &OG_(store_check_range) ),
+                          mkIRExprVec_2(addr, mkHostWord(tyAddr, len)));
+   di->guard = gen_store_guard(bbOut, tyAddr, addr, len, NULL);
+   di->mFx   = Ifx_Read;
+   di->mAddr = addr;
+   di->mSize = len;
+   addStmtToIRSB(bbOut, IRStmt_Dirty(di));
+}
+
+static
+IRSB* og_instrument ( VgCallbackClosure* closure,
                       IRSB* bb_in,
                       VexGuestLayout* layout, 
                       VexGuestExtents* vge,
@@ -1054,6 +2296,18 @@ IRSB* og_instrument ( VgCallbackClosure* closure,
 {
    Int i;
    IRSB*    bbOut;
+   /* The checks enabled for the current guest instruction. */
+   Bool     unw   = OG_(clo_check_unwritable);
+   Bool     refs  = OG_(clo_check_refs);
+   Bool     loads = OG_(clo_check_loads);
+   StmtInfo* info;
+
+   if (!checking_on)
+      return bb_in;
+
+   info = VG_(calloc)("og.instrument.info", bb_in->stmts_used + 1,
+                      sizeof(StmtInfo));
+   scan_superblock(bb_in, info, layout->offset_SP, hWordTy);
 
    /* Set up BB */
    bbOut           = emptyIRSB();
@@ -1065,6 +2319,7 @@ IRSB* og_instrument ( VgCallbackClosure* closure,
    for (i = 0; i < bb_in->stmts_used; i++) {
       IRStmt* const st = bb_in->stmts[i];
       IRStoreG* sg = NULL;
+      IRLoadG*  lg = NULL;
       tl_assert(st);
       tl_assert(isFlatIRStmt(st));
        
@@ -1074,22 +2329,57 @@ IRSB* og_instrument ( VgCallbackClosure* closure,
       case Ist_Put:
       case Ist_PutI:
       case Ist_MBE:
+      case Ist_Dirty:
+      case Ist_LLSC:
+      case Ist_Exit:
+          addStmtToIRSB(bbOut, st);
+          break;
       case Ist_IMark:
+          addStmtToIRSB(bbOut, st);
+          if (scope_given) {
+              InsnScope scope = info[i].scope;
+              unw   = OG_(clo_check_unwritable) && scope == Scope_Check;
+              refs  = OG_(clo_check_refs)       && scope != Scope_Skip;
+              loads = OG_(clo_check_loads)      && scope == Scope_Check;
+          }
+          break;
       case Ist_WrTmp:
+          addStmtToIRSB(bbOut, st);
+          if (loads && st->Ist.WrTmp.data->tag == Iex_Load)
+              insert_load_checker(bbOut, st->Ist.WrTmp.data->Iex.Load.addr,
+                                  mkexpr(st->Ist.WrTmp.tmp), NULL, hWordTy);
+          break;
       case Ist_LoadG:
-      case Ist_Dirty:
-      case Ist_LLSC:
-      case Ist_Exit:
           addStmtToIRSB(bbOut, st);
+          lg = st->Ist.LoadG.details;
+          if (loads && lg->cvt == ILGop_Ident32)
+              insert_load_checker(bbOut, lg->addr, mkexpr(lg->dst),
+                                  lg->guard, hWordTy);
           break;
       case Ist_Store:
-          insert_store_checker(bbOut, st->Ist.Store.addr, st->Ist.Store.data, NULL, hWordTy);
-          addStmtToIRSB(bbOut, st);
+          if (info[i].stack) {
+              addStmtToIRSB(bbOut, st);
+              break;
+          }
+          if (info[i].grouped) {
+              addStmtToIRSB(bbOut, st);
+              if (info[i].last)
+                  gen_store_range_check(bbOut, hWordTy, info[i].base,
+                                        info[i].lo, info[i].hi);
+              break;
+          }
+          insert_store_checker(bbOut, st, st->Ist.Store.addr,
+                               st->Ist.Store.data, NULL, hWordTy,
+                               unw, refs);
           break;
       case Ist_StoreG:
           sg = st->Ist.StoreG.details;
-          insert_store_checker(bbOut, sg->addr, sg->data, sg->guard, hWordTy);
-          addStmtToIRSB(bbOut, st);
+          if (info[i].stack) {
+              addStmtToIRSB(bbOut, st);
+              break;
+          }
+          insert_store_checker(bbOut, st, sg->addr, sg->data, sg->guard,
+                               hWordTy, unw, refs);
           break;
       case Ist_CAS:
           /* TODO */
@@ -1101,9 +2391,197 @@ IRSB* og_instrument ( VgCallbackClosure* closure,
       }
    }
 
+   VG_(free)(info);
    return bbOut;
 }
 
+/*------------------------------------------------------------*/
+/*--- Address space tracking                               ---*/
+/*------------------------------------------------------------*/
+
+/* True if every secmap overlapping [a, a+len) is either the
+   distinguished NOCHECK secmap or has no radix node at all, in which
+   case there is nothing to reset. */
+static Bool range_is_all_nocheck ( Addr a, SizeT len )
+{
+   Addr    end = a + len - 1;
+   SecMap* sm;
+
+   if (len == 0)
+      return True;
+   if (end < a)
+      end = ~(Addr)0;
+   a = start_of_this_sm(a);
+   while (True) {
+      sm = maybe_get_secmap_for(a);
+      if (sm != NULL && sm != &sm_distinguished[SM_DIST_NOCHECK])
+         return False;
+      if (a >= start_of_this_sm(end))
+         return True;
+      a += SM_SIZE;
+   }
+}
+
+/* Forget everything about [a, a+len).  The secmaps at either end may
+   only be partially covered, so see whether they can now go back to
+   the distinguished NOCHECK map; the ones in between already have.
+   Clearing part of a distinguished secmap allocates one, so this is
+   also a point where a pending compaction gets run. */
+static void reset_range ( Addr a, SizeT len )
+{
+   SecMap** sm_ptr;
+
+   if (range_is_all_nocheck(a, len))
+      return;
+   set_address_range_perms(a, len, A_BITS16_NOCHECK, SM_DIST_NOCHECK);
+
+   sm_ptr = get_secmap_ptr(a);
+   maybe_reclaim_secmap(sm_ptr);
+   if (start_of_this_sm(a + len - 1) != start_of_this_sm(a)) {
+      sm_ptr = get_secmap_ptr(a + len - 1);
+      maybe_reclaim_secmap(sm_ptr);
+   }
+   compact_secmaps_if_pending();
+}
+
+static void og_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
+                              ULong di_handle )
+{
+   reset_range(a, len);
+}
+
+static void og_die_mem_munmap ( Addr a, SizeT len )
+{
+   reset_range(a, len);
+}
+
+static void og_die_mem_brk ( Addr a, SizeT len )
+{
+   reset_range(a, len);
+}
+
+/* Called on every SP increase, so don't go scanning secmaps here.
+   Stacks are almost always in NOCHECK secmaps anyway; only when they
+   aren't can a secmap be allocated and a compaction become due. */
+static void og_die_mem_stack ( Addr a, SizeT len )
+{
+   if (LIKELY(range_is_all_nocheck(a, len)))
+      return;
+   set_address_range_perms(a, len, A_BITS16_NOCHECK, SM_DIST_NOCHECK);
+   compact_secmaps_if_pending();
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Shadow dumps                                         ---*/
+/*------------------------------------------------------------*/
+
+/* The whole shadow state can be written to a file, in the format in
+   og_shadow_dump.h, for og_print to show offline.  The maps are walked
+   in address order through a RunAcc, so a distinguished secmap costs
+   one call, and the runs are streamed out through a fixed buffer.
+   n_runs is only known at the end, so the header is written twice. */
+
+const HChar* OG_(clo_dump_shadow_at_exit) = NULL;
+
+#define DUMP_BUF_RUNS 4096   /* 64KB */
+
+typedef
+   struct {
+      Int       fd;
+      Bool      failed;
+      UInt      n_buf;
+      ULong     n_runs;
+      OgDumpRun buf[DUMP_BUF_RUNS];
+   }
+   DumpState;
+
+static void flush_dump_buf ( DumpState* ds )
+{
+   Int szB = ds->n_buf * sizeof(OgDumpRun);
+
+   if (!ds->failed && szB > 0 && VG_(write)(ds->fd, ds->buf, szB) != szB)
+      ds->failed = True;
+   ds->n_buf = 0;
+}
+
+static void dump_run ( Addr a, SizeT len, UChar abits2, void* opaque )
+{
+   DumpState* ds = opaque;
+
+   if (abits2 == A_BITS2_NOCHECK)
+      return;
+   ds->buf[ds->n_buf].start     = a;
+   ds->buf[ds->n_buf].len_state = ((ULong)len << 2) | abits2;
+   ds->n_runs++;
+   if (++ds->n_buf == DUMP_BUF_RUNS)
+      flush_dump_buf(ds);
+}
+
+static void dump_secmap_cb ( Addr base, SecMap** sm_ptr, void* opaque )
+{
+   add_secmap_to_run(opaque, *sm_ptr, base, 0, SM_SIZE);
+}
+
+/* Returns True if the whole dump was written; *n_runs is set either
+   way. */
+static Bool dump_shadow ( const HChar* file, ULong* n_runs )
+{
+   SysRes       sres;
+   OgDumpHeader hdr;
+   DumpState*   ds;
+   RunAcc       acc;
+   Bool         ok;
+
+   *n_runs = 0;
+   sres = VG_(open)(file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                    VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres))
+      return False;
+   ds = VG_(calloc)("og.dump.1", 1, sizeof(DumpState));
+   ds->fd = sr_Res(sres);
+
+   VG_(memset)(&hdr, 0, sizeof(hdr));
+   VG_(memcpy)(hdr.magic, OG_DUMP_MAGIC, sizeof(hdr.magic));
+   hdr.version    = OG_DUMP_VERSION;
+   hdr.byte_order = OG_DUMP_BYTE_ORDER;
+   hdr.header_szB = sizeof(hdr);
+   hdr.gran_shift = og_gran_shift;
+   if (VG_(write)(ds->fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+      ds->failed = True;
+
+   init_run_acc(&acc, dump_run, ds);
+   foreach_secmap(dump_secmap_cb, &acc);
+   flush_run(&acc);
+   flush_dump_buf(ds);
+
+   hdr.n_runs = ds->n_runs;
+   if (!ds->failed
+       && (VG_(lseek)(ds->fd, 0, VKI_SEEK_SET) != 0
+           || VG_(write)(ds->fd, &hdr, sizeof(hdr)) != sizeof(hdr)))
+      ds->failed = True;
+   VG_(close)(ds->fd);
+
+   ok      = !ds->failed;
+   *n_runs = ds->n_runs;
+   VG_(free)(ds);
+   return ok;
+}
+
+static void dump_shadow_at_exit ( void )
+{
+   HChar* file = VG_(expand_file_name)("--dump-shadow-at-exit",
+                                       OG_(clo_dump_shadow_at_exit));
+   ULong  n_runs;
+
+   if (dump_shadow(file, &n_runs))
+      VG_(umsg)("Shadow state written to %s (%llu runs)\n", file, n_runs);
+   else
+      VG_(umsg)("Warning: couldn't write the shadow state to %s\n", file);
+   VG_(free)(file);
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Client requests                                      ---*/
 /*------------------------------------------------------------*/
@@ -1120,16 +2598,594 @@ remove_refcheck_field(Addr field)
     set_abits2(field, A_BITS2_NOCHECK);
 }
 
+/* Set the fields at a, a+stride, ... below a+len to abits2, fetching
+   each secmap once.  Removing fields from a NOCHECK secmap is a no-op,
+   so those secmaps are skipped without being copied. */
+static UWord set_refcheck_fields ( Addr a, SizeT len, SizeT stride,
+                                   UChar abits2 )
+{
+   Addr    end = a + len;
+   Addr    sm_end;
+   SecMap* sm;
+   UWord   n = 0;
+
+   if (stride == 0 || end < a)
+      return 0;
+   while (a < end) {
+      sm_end = start_of_this_sm(a) + SM_SIZE;
+      if (sm_end > end || sm_end == 0)
+         sm_end = end;
+      if (abits2 == A_BITS2_NOCHECK) {
+         sm = maybe_get_secmap_for(a);
+         if (sm == NULL || sm == &sm_distinguished[SM_DIST_NOCHECK]) {
+            a += ((sm_end - a + stride - 1) / stride) * stride;
+            continue;
+         }
+      }
+      sm = get_secmap_for_writing(a);
+      for (; a < sm_end; a += stride, n++)
+         insert_abits2_into_abits8( a, abits2, &(sm->abits8[SM_OFF(a)]) );
+   }
+   return n;
+}
+
+/* Same for an array of n field addresses in client memory.  The
+   secmap is only looked up again when the field moves to a different
+   64KB region. */
+static UWord set_refcheck_field_array ( Addr fields, UWord n, UChar abits2 )
+{
+   const Addr* f = (const Addr*)fields;
+   Addr        base = 0;
+   SecMap*     sm = NULL;
+   UWord       i;
+
+   if (n == 0)
+      return 0;
+   if (!VG_(am_is_valid_for_client)(fields, n * sizeof(Addr),
+                                    VKI_PROT_READ)) {
+      VG_(message)(Vg_UserMsg,
+                   "Warning: refcheck field array [0x%lx, +%lu) "
+                   "is not readable\n", fields, n * sizeof(Addr));
+      return 0;
+   }
+   for (i = 0; i < n; i++) {
+      if (sm == NULL || start_of_this_sm(f[i]) != base) {
+         base = start_of_this_sm(f[i]);
+         sm   = get_secmap_for_writing(f[i]);
+      }
+      insert_abits2_into_abits8( f[i], abits2, &(sm->abits8[SM_OFF(f[i])]) );
+   }
+   return n;
+}
+
+/* --------------- Object layouts --------------- */
+
+/* A registered object shape.  The shadow image of an object is
+   precomputed as abits8 bytes for each of the four positions
+   ("phases") the object's first granule can have within an abits8
+   byte.  Only the first and last bytes of an image are shared with
+   neighbouring memory; first_mask/last_mask select the bits that
+   belong to the object. */
+typedef
+   struct {
+      SizeT  size;
+      UWord  n_abits8[4];
+      UChar* image[4];
+      UChar  first_mask[4];
+      UChar  last_mask[4];
+   }
+   ObjLayout;
+
+/* Indexed by type id - 1, so that 0 can mean "no such type". */
+static XArray* obj_layouts = NULL;
+
+static INLINE Bool test_word_bit ( const UChar* bitmap, UWord w )
+{
+   return bitmap != NULL && (bitmap[w >> 3] & (1 << (w & 7))) != 0;
+}
+
+/* State of the object granule starting at byte offset 'off'.  An
+   unwritable word is unwritable throughout; a reference field is
+   checked at its first byte, like VALGRIND_ADD_REFCHECK_FIELD. */
+static UChar layout_abits2_at ( SizeT off, const UChar* refmap,
+                                const UChar* unwritablemap )
+{
+   UWord w = off / VG_WORDSIZE;
+   if (test_word_bit(unwritablemap, w))
+      return A_BITS2_UNWRITABLE;
+   if (test_word_bit(refmap, w) && off % VG_WORDSIZE == 0)
+      return A_BITS2_REFCHECK;
+   return A_BITS2_NOCHECK;
+}
+
+static UWord register_object_layout ( SizeT size, Addr refmap,
+                                      Addr unwritablemap )
+{
+   ObjLayout* l;
+   SizeT      map_szB;
+   UWord      n_gran, p, g, pos;
+   UChar      abits2;
+
+   if (size == 0)
+      return 0;
+   map_szB = ((size - 1) / VG_WORDSIZE) / 8 + 1;
+   if ((refmap != 0
+        && !VG_(am_is_valid_for_client)(refmap, map_szB, VKI_PROT_READ))
+       || (unwritablemap != 0
+        && !VG_(am_is_valid_for_client)(unwritablemap, map_szB,
+                                        VKI_PROT_READ))) {
+      VG_(message)(Vg_UserMsg,
+                   "Warning: object layout bitmap is not readable\n");
+      return 0;
+   }
+   if (obj_layouts == NULL)
+      obj_layouts = VG_(newXA)(VG_(malloc), "og.layout.1", VG_(free),
+                               sizeof(ObjLayout*));
+
+   l = VG_(malloc)("og.layout.2", sizeof(ObjLayout));
+   l->size = size;
+   n_gran  = (size + (1 << og_gran_shift) - 1) >> og_gran_shift;
+   for (p = 0; p < 4; p++) {
+      l->n_abits8[p] = (p + n_gran + 3) / 4;
+      l->image[p]    = VG_(calloc)("og.layout.3", l->n_abits8[p], 1);
+      l->first_mask[p] = l->last_mask[p] = 0;
+      for (g = 0; g < n_gran; g++) {
+         pos    = p + g;
+         abits2 = layout_abits2_at(g << og_gran_shift,
+                                   (const UChar*)refmap,
+                                   (const UChar*)unwritablemap);
+         l->image[p][pos / 4] |= abits2 << ((pos & 3) << 1);
+         if (pos / 4 == 0)
+            l->first_mask[p] |= 0x3 << ((pos & 3) << 1);
+         if (pos / 4 == l->n_abits8[p] - 1)
+            l->last_mask[p]  |= 0x3 << ((pos & 3) << 1);
+      }
+   }
+   VG_(addToXA)(obj_layouts, &l);
+   return VG_(sizeXA)(obj_layouts);
+}
+
+static INLINE void merge_abits8 ( Addr a, UChar image, UChar mask )
+{
+   SecMap* sm = get_secmap_for_writing(a);
+   UChar*  p  = &(sm->abits8[SM_OFF(a)]);
+   *p = (*p & ~mask) | (image & mask);
+}
+
+/* Stamp the shadow image of type 'type_id' onto [a, a+size).  The
+   middle of the image is copied a secmap at a time; only the two end
+   bytes need merging with their neighbours. */
+static Bool make_object ( Addr a, UWord type_id )
+{
+   ObjLayout* l;
+   UWord      p, n, last, j, chunk;
+   UChar*     img;
+   Addr       b, bj;
+   UWord      step = ((UWord)4) << og_gran_shift; // bytes per abits8
+
+   if (obj_layouts == NULL || type_id == 0
+       || type_id > VG_(sizeXA)(obj_layouts))
+      return False;
+   if (og_gran_shift > 0 && !VG_IS_WORD_ALIGNED(a))
+      return False;
+   l    = *(ObjLayout**)VG_(indexXA)(obj_layouts, type_id - 1);
+   p    = (a >> og_gran_shift) & 3;
+   img  = l->image[p];
+   n    = l->n_abits8[p];
+   last = n - 1;
+   b    = a & ~(Addr)(step - 1);
+
+   merge_abits8(b, img[0], l->first_mask[p]);
+   if (last > 0)
+      merge_abits8(b + last * step, img[last], l->last_mask[p]);
+
+   for (j = 1; j < last; j += chunk) {
+      SecMap* sm;
+      bj    = b + j * step;
+      chunk = (SM_SIZE - (bj & SM_MASK)) / step;
+      if (chunk > last - j)
+         chunk = last - j;
+      sm = get_secmap_for_writing(bj);
+      VG_(memcpy)(&(sm->abits8[SM_OFF(bj)]), &img[j], chunk);
+   }
+   return True;
+}
+
+/* --------------- Range queries --------------- */
+
+/* COUNT_STATE, FIND_STATE and GET_STATE_BITMAP answer for a whole
+   range in one request.  Like the monitor commands they go through a
+   RunAcc, so distinguished secmaps and uniform words of abits8 are
+   taken in one step. */
+
+typedef
+   struct {
+      UChar abits2;    // the state asked about
+      ULong n_bytes;   // # bytes in it so far
+      Addr  first;     // the first of them, if n_bytes > 0
+   }
+   StateQuery;
+
+static void state_query_run ( Addr a, SizeT len, UChar abits2, void* opaque )
+{
+   StateQuery* q = opaque;
+
+   if (abits2 != q->abits2)
+      return;
+   if (q->n_bytes == 0)
+      q->first = a;
+   q->n_bytes += len;
+}
+
+/* Scan [a, a+len) for bytes in state abits2.  With stop_at_first, stop
+   at the secmap where the first one is found. */
+static void query_state ( StateQuery* q, Addr a, SizeT len, UChar abits2,
+                          Bool stop_at_first )
+{
+   RunAcc acc;
+
+   q->abits2  = abits2;
+   q->n_bytes = 0;
+   q->first   = 0;
+   if (len == 0 || a + len - 1 < a)
+      return;
+   init_run_acc(&acc, state_query_run, q);
+   while (len > 0 && !(stop_at_first && q->n_bytes > 0)) {
+      SizeT chunk = SM_SIZE - (a & SM_MASK);
+      if (chunk > len)
+         chunk = len;
+      add_range_to_run(&acc, a, chunk);
+      a   += chunk;
+      len -= chunk;
+   }
+   flush_run(&acc);
+}
+
+typedef
+   struct {
+      Addr   base;
+      UChar* bitmap;
+   }
+   StateBitmap;
+
+/* Each word takes the state of its first byte; the words whose first
+   byte is in this run are the ones starting in it.  The bitmap starts
+   out zeroed, i.e. NOCHECK. */
+static void state_bitmap_run ( Addr a, SizeT len, UChar abits2, void* opaque )
+{
+   StateBitmap* sb = opaque;
+   Addr         w;
+
+   if (abits2 == A_BITS2_NOCHECK)
+      return;
+   for (w = VG_ROUNDUP(a, sizeof(UWord)); w - a < len; w += sizeof(UWord)) {
+      UWord i = (w - sb->base) / sizeof(UWord);
+      sb->bitmap[i >> 2] |= abits2 << ((i & 3) << 1);
+   }
+}
+
+/* Write 2 bits per word of [a, a+len) to bitmap, four words to a byte,
+   packed like abits8.  Returns the number of words, 0 if a isn't word
+   aligned or the bitmap isn't writable. */
+static UWord get_state_bitmap ( Addr a, SizeT len, Addr bitmap )
+{
+   UWord       n_words = len / sizeof(UWord);
+   SizeT       map_szB = (n_words + 3) / 4;
+   StateBitmap sb;
+   RunAcc      acc;
+
+   if (!VG_IS_WORD_ALIGNED(a) || n_words == 0
+       || a + n_words * sizeof(UWord) - 1 < a)
+      return 0;
+   if (!VG_(am_is_valid_for_client)(bitmap, map_szB, VKI_PROT_WRITE)) {
+      VG_(message)(Vg_UserMsg,
+                   "Warning: state bitmap [0x%lx, +%lu) "
+                   "is not writable\n", bitmap, map_szB);
+      return 0;
+   }
+   sb.base   = a;
+   sb.bitmap = (UChar*)bitmap;
+   VG_(memset)(sb.bitmap, 0, map_szB);
+   init_run_acc(&acc, state_bitmap_run, &sb);
+   add_range_to_run(&acc, a, n_words * sizeof(UWord));
+   flush_run(&acc);
+   return n_words;
+}
+
+/* --------------- Dangling references --------------- */
+
+/* A REFCHECK field that still points at an object which has since
+   been made UNREFERABLE is only caught when the field is next stored
+   to.  CHECK_DANGLING_REFS and the dangling_refs monitor command find
+   all of them at once: every REFCHECK field in the maps is read and
+   its value looked up.  Distinguished secmaps are never REFCHECK, and
+   the others are searched a word of abits8 at a time. */
+
+typedef
+   struct {
+      void  (*found)(Addr field, UWord value, void* opaque);
+      void* opaque;
+      ULong n_fields;    // REFCHECK fields read
+      ULong n_found;
+      Addr  page;        // the last page checked for readability
+      Bool  page_ok;
+   }
+   DanglingScan;
+
+static Bool scan_page_ok ( DanglingScan* ds, Addr a )
+{
+   if (VG_PGROUNDDN(a) != ds->page) {
+      ds->page    = VG_PGROUNDDN(a);
+      ds->page_ok = VG_(am_is_valid_for_client)(ds->page, VKI_PAGE_SIZE,
+                                                VKI_PROT_READ);
+   }
+   return ds->page_ok;
+}
+
+/* At byte granularity a field needn't be word aligned, and may then
+   straddle two pages. */
+static void scan_field ( DanglingScan* ds, Addr field )
+{
+   UWord value;
+
+   if (!scan_page_ok(ds, field + sizeof(UWord) - 1)
+       || !scan_page_ok(ds, field))
+      return;
+   ds->n_fields++;
+   VG_(memcpy)(&value, (void*)field, sizeof(value));
+   if (get_abits2(value) == A_BITS2_UNREFERABLE) {
+      ds->n_found++;
+      ds->found(field, value, ds->opaque);
+   }
+}
+
+static void scan_secmap_for_dangling ( Addr base, SecMap** sm_ptr,
+                                       void* opaque )
+{
+   const UWord  lo_bits = ~(UWord)0 / 3;            // 0101...01b
+   const UWord  n_gran  = 4 * sizeof(UWord);        // granules per word
+   const UWord* w       = (const UWord*)(*sm_ptr)->abits8;
+   UWord        i, j;
+
+   if (is_distinguished_sm(*sm_ptr))
+      return;
+   for (i = 0; i < sm_bytes / sizeof(UWord); i++) {
+      /* The low bit of each 11b (REFCHECK) pair. */
+      UWord refs = w[i] & (w[i] >> 1) & lo_bits;
+      if (LIKELY(refs == 0))
+         continue;
+      for (j = 0; j < n_gran; j++) {
+         Addr a;
+         if (((refs >> (2 * j)) & 1) == 0)
+            continue;
+         a = base + ((i * n_gran + j) << og_gran_shift);
+         /* Only a field's first granule is REFCHECK, as for the store
+            checks, so this is where it starts. */
+         scan_field(opaque, a);
+      }
+   }
+}
+
+/* Calls found for each dangling reference and returns how many there
+   were; *n_fields is set to the number of REFCHECK fields read. */
+static ULong scan_dangling_refs ( void (*found)(Addr, UWord, void*),
+                                  void* opaque, ULong* n_fields )
+{
+   DanglingScan ds;
+
+   ds.found    = found;
+   ds.opaque   = opaque;
+   ds.n_fields = 0;
+   ds.n_found  = 0;
+   ds.page     = 1;   /* never a page address */
+   ds.page_ok  = False;
+   foreach_secmap(scan_secmap_for_dangling, &ds);
+   *n_fields = ds.n_fields;
+   return ds.n_found;
+}
+
+/* All the fields found by one scan share the caller's code address,
+   so these are keyed by field rather than counted per site. */
+static void report_dangling_ref ( Addr field, UWord value, void* opaque )
+{
+   OgErrorExtra extra;
+
+   get_unreferable_extra(&extra, field, value);
+   OG_(record_field_error)(DanglingRefErr, field, &extra);
+}
+
+/* Names for --stats=yes, in Vg_ObjgrindClientRequest order. */
+static const HChar* const og_request_names[] = {
+   "MAKE_NOCHECK", "MAKE_UNWRITABLE", "MAKE_UNREFERABLE",
+   "ADD_REFCHECK_FIELD", "REMOVE_REFCHECK_FIELD", "CHECK_UNWRITABLE",
+   "COMPACT_SHADOW", "ADD_REFCHECK_FIELDS", "REMOVE_REFCHECK_FIELDS",
+   "ADD_REFCHECK_FIELD_ARRAY", "REMOVE_REFCHECK_FIELD_ARRAY",
+   "REGISTER_OBJECT_LAYOUT", "MAKE_OBJECT", "PRINT_STATS",
+   "START_CHECKING", "STOP_CHECKING", "ENABLE_THREAD_CHECKING",
+   "DISABLE_THREAD_CHECKING", "DUMP_SHADOW", "COUNT_STATE", "FIND_STATE",
+   "GET_STATE_BITMAP", "CHECK_DANGLING_REFS",
+};
+#define N_OG_REQUESTS \
+   (sizeof(og_request_names) / sizeof(og_request_names[0]))
+
+static ULong n_client_requests[N_OG_REQUESTS] = { 0 };
+
+static void og_print_stats ( void );
+
+static void print_monitor_help ( void )
+{
+   VG_(gdb_printf) (
+"\n"
+"objgrind monitor commands:\n"
+"  state <addr> [<len>]\n"
+"        list the runs of bytes in one state in [addr, addr+len)\n"
+"  summary <addr> <len>\n"
+"        count the bytes and runs in each state in [addr, addr+len)\n"
+"  stats\n"
+"        print the statistics --stats=yes prints at exit\n"
+"  dump_shadow <file>\n"
+"        write the shadow state to <file>, to be shown with og_print\n"
+"  dangling_refs\n"
+"        list refcheck fields holding unreferable values\n"
+"\n");
+}
+
+/* The state command lists at most this many runs. */
+#define MAX_MONITOR_RUNS 100
+
+typedef
+   struct {
+      ULong n_runs[4];
+      ULong n_bytes[4];
+      Bool  print;
+   }
+   RangeSummary;
+
+static void summarise_run ( Addr a, SizeT len, UChar abits2, void* opaque )
+{
+   RangeSummary* rs = opaque;
+   ULong n = rs->n_runs[0] + rs->n_runs[1] + rs->n_runs[2] + rs->n_runs[3];
+
+   if (rs->print && n < MAX_MONITOR_RUNS)
+      VG_(gdb_printf)("0x%lx-0x%lx %lu bytes %s\n",
+                      a, a + len, len, OG_(state_names)[abits2]);
+   rs->n_runs[abits2]++;
+   rs->n_bytes[abits2] += len;
+}
+
+static void print_dangling_ref ( Addr field, UWord value, void* opaque )
+{
+   ULong* n_printed = opaque;
+
+   if ((*n_printed)++ < MAX_MONITOR_RUNS)
+      VG_(gdb_printf)("field 0x%lx holds 0x%lx\n", field, value);
+}
+
+/* Parses "<addr> [<len>]" into *a and *len; len defaults to 1 if
+   len_optional.  Complains to gdb and returns False if that fails. */
+static Bool get_monitor_range ( HChar** ssaveptr, Addr* a, SizeT* len,
+                                Bool len_optional )
+{
+   *len = 0;   /* left alone if no length is given */
+   if (!VG_(strtok_get_address_and_size)(a, len, ssaveptr))
+      return False;
+   if (*len == 0) {
+      if (!len_optional) {
+         VG_(gdb_printf)("missing or zero length\n");
+         return False;
+      }
+      *len = 1;
+   }
+   if (*a + *len - 1 < *a) {
+      VG_(gdb_printf)("range wraps around the address space\n");
+      return False;
+   }
+   return True;
+}
+
+/* Returns True if req is an objgrind monitor command, whether or not
+   it succeeded. */
+static Bool handle_gdb_monitor_command ( ThreadId tid, HChar* req )
+{
+   HChar* wcmd;
+   HChar  s[VG_(strlen(req)) + 1]; /* copy for strtok_r */
+   HChar* ssaveptr;
+   Int    kwdid;
+
+   VG_(strcpy)(s, req);
+
+   wcmd  = VG_(strtok_r)(s, " ", &ssaveptr);
+   kwdid = VG_(keyword_id)("help state summary stats dump_shadow "
+                           "dangling_refs",
+                           wcmd, kwd_report_duplicated_matches);
+   switch (kwdid) {
+   case -2: /* multiple matches */
+      return True;
+   case -1: /* not found */
+      return False;
+   case  0: /* help */
+      print_monitor_help();
+      return True;
+   case  1:   /* state */
+   case  2: { /* summary */
+      Bool         is_state = kwdid == 1;
+      RangeSummary rs;
+      RunAcc       acc;
+      Addr         a;
+      SizeT        len;
+      ULong        n;
+      UInt         i;
+
+      if (!get_monitor_range(&ssaveptr, &a, &len, is_state))
+         return True;
+      VG_(memset)(&rs, 0, sizeof(rs));
+      rs.print = is_state;
+      init_run_acc(&acc, summarise_run, &rs);
+      add_range_to_run(&acc, a, len);
+      flush_run(&acc);
+
+      n = rs.n_runs[0] + rs.n_runs[1] + rs.n_runs[2] + rs.n_runs[3];
+      if (is_state) {
+         if (n > MAX_MONITOR_RUNS)
+            VG_(gdb_printf)("... and %llu more runs\n",
+                            n - MAX_MONITOR_RUNS);
+         return True;
+      }
+      for (i = 0; i < 4; i++)
+         VG_(gdb_printf)("%-12s %llu bytes in %llu runs\n",
+                         OG_(state_names)[i],
+                         rs.n_bytes[i], rs.n_runs[i]);
+      return True;
+   }
+   case  3: /* stats */
+      og_print_stats();
+      return True;
+   case  4: { /* dump_shadow */
+      HChar* file = VG_(strtok_r)(NULL, " ", &ssaveptr);
+      ULong  n_runs;
+      if (file == NULL) {
+         VG_(gdb_printf)("missing file name\n");
+         return True;
+      }
+      if (dump_shadow(file, &n_runs))
+         VG_(gdb_printf)("shadow state written to %s (%llu runs)\n",
+                         file, n_runs);
+      else
+         VG_(gdb_printf)("couldn't write %s\n", file);
+      return True;
+   }
+   case  5: { /* dangling_refs */
+      ULong n_fields, n_found, n_printed = 0;
+      n_found = scan_dangling_refs(print_dangling_ref, &n_printed, &n_fields);
+      if (n_found > MAX_MONITOR_RUNS)
+         VG_(gdb_printf)("... and %llu more\n", n_found - MAX_MONITOR_RUNS);
+      VG_(gdb_printf)("%llu dangling references in %llu refcheck fields\n",
+                      n_found, n_fields);
+      return True;
+   }
+   default:
+      tl_assert(0);
+      return False;
+   }
+}
+
 static Bool og_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
 {
+   UWord ix;
+
    if (!VG_IS_TOOL_USERREQ('O','G',arg[0])
        && VG_USERREQ__MAKE_NOCHECK != arg[0]
        && VG_USERREQ__MAKE_UNWRITABLE != arg[0]
        && VG_USERREQ__MAKE_UNREFERABLE != arg[0]
        && VG_USERREQ__ADD_REFCHECK_FIELD != arg[0]
-       && VG_USERREQ__REMOVE_REFCHECK_FIELD != arg[0])
+       && VG_USERREQ__REMOVE_REFCHECK_FIELD != arg[0]
+       && VG_USERREQ__GDB_MONITOR_COMMAND != arg[0])
       return False;
 
+   ix = arg[0] - VG_USERREQ__MAKE_NOCHECK;
+   if (ix < N_OG_REQUESTS)
+      n_client_requests[ix]++;
+
    switch (arg[0]) {
    case VG_USERREQ__MAKE_NOCHECK:
        set_address_range_perms(arg[1], arg[2], A_BITS16_NOCHECK, SM_DIST_NOCHECK);
@@ -1139,6 +3195,8 @@ static Bool og_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
        break;
    case VG_USERREQ__MAKE_UNREFERABLE:
        set_address_range_perms(arg[1], arg[2], A_BITS16_UNREFERABLE, SM_DIST_UNREFERABLE);
+       if (OG_(clo_track_unreferable_origins))
+          record_unreferable_origin(tid, arg[1], arg[2]);
        break;
    case VG_USERREQ__ADD_REFCHECK_FIELD:
        add_refcheck_field(arg[1]);
@@ -1149,6 +3207,72 @@ static Bool og_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
    case VG_USERREQ__CHECK_UNWRITABLE:
       *ret = (get_abits2(arg[1]) == A_BITS2_UNWRITABLE);
       break;
+   case VG_USERREQ__COMPACT_SHADOW:
+      *ret = compact_secmaps();
+      break;
+   case VG_USERREQ__ADD_REFCHECK_FIELDS:
+      *ret = set_refcheck_fields(arg[1], arg[2], arg[3], A_BITS2_REFCHECK);
+      break;
+   case VG_USERREQ__REMOVE_REFCHECK_FIELDS:
+      *ret = set_refcheck_fields(arg[1], arg[2], arg[3], A_BITS2_NOCHECK);
+      break;
+   case VG_USERREQ__ADD_REFCHECK_FIELD_ARRAY:
+      *ret = set_refcheck_field_array(arg[1], arg[2], A_BITS2_REFCHECK);
+      break;
+   case VG_USERREQ__REMOVE_REFCHECK_FIELD_ARRAY:
+      *ret = set_refcheck_field_array(arg[1], arg[2], A_BITS2_NOCHECK);
+      break;
+   case VG_USERREQ__REGISTER_OBJECT_LAYOUT:
+      *ret = register_object_layout(arg[1], arg[2], arg[3]);
+      break;
+   case VG_USERREQ__MAKE_OBJECT:
+      *ret = make_object(arg[1], arg[2]);
+      break;
+   case VG_USERREQ__PRINT_STATS:
+      og_print_stats();
+      break;
+   case VG_USERREQ__START_CHECKING:
+      set_checking(True);
+      break;
+   case VG_USERREQ__STOP_CHECKING:
+      set_checking(False);
+      break;
+   case VG_USERREQ__ENABLE_THREAD_CHECKING:
+      set_thread_checking(tid, True);
+      break;
+   case VG_USERREQ__DISABLE_THREAD_CHECKING:
+      set_thread_checking(tid, False);
+      break;
+   case VG_USERREQ__DUMP_SHADOW: {
+      ULong n_runs;
+      *ret = dump_shadow((const HChar*)arg[1], &n_runs);
+      break;
+   }
+   case VG_USERREQ__COUNT_STATE: {
+      StateQuery q;
+      query_state(&q, arg[1], arg[2], arg[3] & 3, False);
+      *ret = q.n_bytes;
+      break;
+   }
+   case VG_USERREQ__FIND_STATE: {
+      StateQuery q;
+      query_state(&q, arg[1], arg[2], arg[3] & 3, True);
+      *ret = q.n_bytes > 0 ? q.first - arg[1] : (UWord)-1;
+      break;
+   }
+   case VG_USERREQ__GET_STATE_BITMAP:
+      *ret = get_state_bitmap(arg[1], arg[2], arg[3]);
+      break;
+   case VG_USERREQ__CHECK_DANGLING_REFS: {
+      ULong n_fields;
+      *ret = scan_dangling_refs(report_dangling_ref, NULL, &n_fields);
+      break;
+   }
+   case VG_USERREQ__GDB_MONITOR_COMMAND: {
+      Bool handled = handle_gdb_monitor_command(tid, (HChar*)arg[1]);
+      *ret = handled;
+      return handled;
+   }
 
    default:
        VG_(message)(
@@ -1158,9 +3282,113 @@ static Bool og_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
            );
        return False;
    }
+   /* Secmaps are allocated by range requests and by the address
+      space callbacks (see reset_range), so a pending compaction is
+      run after either. */
+   compact_secmaps_if_pending();
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Command line options                                 ---*/
+/*------------------------------------------------------------*/
+
+UInt OG_(clo_max_errors_per_site) = 1;
+
+static Bool og_process_cmd_line_option(const HChar* arg)
+{
+   const HChar* tmp_str;
+
+   if VG_STR_CLO(arg, "--granularity", tmp_str) {
+      if (0 == VG_(strcmp)(tmp_str, "byte"))
+         og_gran_shift = 0;
+      else if (0 == VG_(strcmp)(tmp_str, "word"))
+         og_gran_shift = VG_WORDSIZE == 8 ? 3 : 2;
+      else
+         return False;
+   }
+   else if VG_BINT_CLO(arg, "--max-errors-per-site",
+                       OG_(clo_max_errors_per_site), 0, 1000000000) {}
+   else if VG_BOOL_CLO(arg, "--check-unwritable",
+                       OG_(clo_check_unwritable)) {}
+   else if VG_BOOL_CLO(arg, "--check-refs", OG_(clo_check_refs)) {}
+   else if VG_BOOL_CLO(arg, "--check-loads", OG_(clo_check_loads)) {}
+   else if VG_BOOL_CLO(arg, "--check-at-start", OG_(clo_check_at_start)) {}
+   else if VG_BOOL_CLO(arg, "--coalesce-stores", OG_(clo_coalesce_stores)) {}
+   else if VG_BOOL_CLO(arg, "--ignore-stack-stores",
+                       OG_(clo_ignore_stack_stores)) {}
+   else if VG_STR_CLO(arg, "--instrument-objs", tmp_str)
+      add_scope_patterns(&instrument_objs, tmp_str);
+   else if VG_STR_CLO(arg, "--ignore-objs", tmp_str)
+      add_scope_patterns(&ignore_objs, tmp_str);
+   else if VG_STR_CLO(arg, "--instrument-fns", tmp_str)
+      add_scope_patterns(&instrument_fns, tmp_str);
+   else if VG_STR_CLO(arg, "--ignore-fns", tmp_str)
+      add_scope_patterns(&ignore_fns, tmp_str);
+   else if VG_STR_CLO(arg, "--collector-fns", tmp_str)
+      add_scope_patterns(&collector_fns, tmp_str);
+   else if VG_BOOL_CLO(arg, "--track-unreferable-origins",
+                       OG_(clo_track_unreferable_origins)) {}
+   else if VG_BINT_CLO(arg, "--unreferable-origins-depth",
+                       OG_(clo_unreferable_origins_depth),
+                       1, MAX_ORIGIN_DEPTH) {}
+   else if VG_BINT_CLO(arg, "--unreferable-origins-max",
+                       OG_(clo_unreferable_origins_max), 1, 1000000000) {}
+   else if VG_STR_CLO(arg, "--dump-shadow-at-exit",
+                      OG_(clo_dump_shadow_at_exit)) {}
+   else
+      return False;
+
    return True;
 }
 
+static void og_print_usage(void)
+{
+   VG_(printf)(
+"    --granularity=byte|word   keep one state per byte, or one per aligned\n"
+"                              machine word to use 1/%d of the shadow\n"
+"                              memory [byte]\n"
+"    --max-errors-per-site=<number>  record at most this many errors from\n"
+"                              any one code address, and just count the\n"
+"                              rest; 0 for no limit [1]\n"
+"    --check-unwritable=yes|no  report stores to unwritable memory [yes]\n"
+"    --check-refs=yes|no       report unreferable values stored to refcheck\n"
+"                              fields [yes]\n"
+"    --check-loads=no|yes      also report unreferable values loaded from\n"
+"                              refcheck fields [no]\n"
+"    --check-at-start=yes|no   check from the start, or only after a\n"
+"                              VALGRIND_START_CHECKING request [yes]\n"
+"    --coalesce-stores=no|yes  check runs of adjacent stores together,\n"
+"                              reporting errors at the last of them [no]\n"
+"    --ignore-stack-stores=no|yes  don't check stores to the stack\n"
+"                              pointer plus or minus a constant [no]\n"
+"    --instrument-objs=<patterns>  only check code in objects matching one\n"
+"                              of these comma-separated patterns [all]\n"
+"    --ignore-objs=<patterns>  don't check code in these objects [none]\n"
+"    --instrument-fns=<patterns>  only check code in these functions [all]\n"
+"    --ignore-fns=<patterns>   don't check code in these functions [none]\n"
+"    --collector-fns=<patterns>  the collector's functions: their stores\n"
+"                              aren't checked for unwritable memory, nor\n"
+"                              their loads [none]\n"
+"    --track-unreferable-origins=no|yes  show where the value in an\n"
+"                              UnreferableError was made unreferable [no]\n"
+"    --unreferable-origins-depth=<number>  frames kept per origin [12]\n"
+"    --unreferable-origins-max=<number>  origins kept before the oldest\n"
+"                              are dropped [1000000]\n"
+"    --dump-shadow-at-exit=<file>  write the shadow state to <file> at\n"
+"                              exit, for og_print; %%p is the pid [no]\n",
+      VG_WORDSIZE
+   );
+}
+
+static void og_print_debug_usage(void)
+{
+   VG_(printf)(
+"    (none)\n"
+   );
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Setup and finalisation                               ---*/
@@ -1168,10 +3396,84 @@ static Bool og_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
 
 static void og_post_clo_init(void)
 {
+   sm_bytes = SM_CHUNKS >> og_gran_shift;
+   checking_on = OG_(clo_check_at_start);
+}
+
+static void og_print_stats ( void )
+{
+   ULong n_stores = 0;
+   ULong in_use   = n_issued_SMs - n_deissued_SMs;
+   UWord i;
+
+   for (i = 0; i < 6; i++)
+      n_stores += n_store_checks[i];
+   n_stores += n_range_checks;
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: store checks: %llu 1B, %llu 2B, %llu 4B, %llu 8B, "
+      "%llu 16B, %llu 32B\n",
+      n_store_checks[0], n_store_checks[1], n_store_checks[2],
+      n_store_checks[3], n_store_checks[4], n_store_checks[5]);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: store checks: %llu of %llu (%llu%%) in distinguished "
+      "secmaps\n",
+      n_store_dsm_hits, n_stores,
+      n_stores ? n_store_dsm_hits * 100 / n_stores : 0ULL);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: range checks: %llu; %llu stores translated into %llu "
+      "groups\n",
+      n_range_checks, n_grouped_stores, n_store_groups);
+   if (OG_(clo_ignore_stack_stores))
+      VG_(message)(Vg_DebugMsg,
+         " objgrind: stack stores: %llu translated without a check\n",
+         n_stack_stores);
+   if (OG_(clo_check_loads))
+      VG_(message)(Vg_DebugMsg,
+         " objgrind: load checks: %llu\n", n_load_checks);
+   if (scope_given)
+      VG_(message)(Vg_DebugMsg,
+         " objgrind: scope: %llu instructions skipped, %llu in collector\n",
+         n_insns_skipped, n_insns_collector);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: errors: %llu record calls\n", n_error_record_calls);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: radix: %llu L2 nodes, %llu L3 nodes (%llu bytes)\n",
+      n_radix_L2_nodes, n_radix_L3_nodes,
+      n_radix_L2_nodes * sizeof(RadixL2) + n_radix_L3_nodes * sizeof(RadixL3));
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: secmaps: %llu issued by copy_for_writing, %llu freed\n",
+      n_issued_SMs, n_deissued_SMs);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: secmaps: %llu in use (%llu bytes), max %llu (%llu bytes)\n",
+      in_use, in_use * sm_bytes, max_SMs_in_use, max_SMs_in_use * sm_bytes);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: compaction: %llu runs, %llu secmaps reclaimed\n",
+      n_sm_compactions, n_sm_reclaimed);
+   if (OG_(clo_track_unreferable_origins))
+      VG_(message)(Vg_DebugMsg,
+         " objgrind: origins: %llu held (%llu bytes), %llu evicted\n",
+         n_origins, n_origins * origin_node_szB, n_origins_evicted);
+   VG_(message)(Vg_DebugMsg,
+      " objgrind: sarp: %llu calls; bytes %llu partial, %llu dsm, "
+      "%llu filled, %llu unchanged\n",
+      n_sarp_calls, n_sarp_bytes_partial, n_sarp_bytes_dsm,
+      n_sarp_bytes_filled, n_sarp_bytes_skipped);
+   for (i = 0; i < N_OG_REQUESTS; i++) {
+      if (n_client_requests[i] == 0)
+         continue;
+      VG_(message)(Vg_DebugMsg,
+         " objgrind: requests: %-27s %llu\n",
+         og_request_names[i], n_client_requests[i]);
+   }
 }
 
 static void og_fini(Int exitcode)
 {
+   OG_(print_error_sites)();
+   if (OG_(clo_dump_shadow_at_exit))
+      dump_shadow_at_exit();
+   if (VG_(clo_stats))
+      og_print_stats();
 }
 
 static void og_pre_clo_init(void)
@@ -1186,7 +3488,17 @@ static void og_pre_clo_init(void)
       "Copyright (C) 2013 Narihiro Nakamura");
    VG_(details_bug_reports_to)  ("www.github.com/authorNari/objgrind");
 
+   VG_(needs_command_line_options)(og_process_cmd_line_option,
+                                   og_print_usage,
+                                   og_print_debug_usage);
    VG_(needs_client_requests)     (og_handle_client_request);
+
+   VG_(track_new_mem_mmap)        (og_new_mem_mmap);
+   VG_(track_die_mem_munmap)      (og_die_mem_munmap);
+   VG_(track_die_mem_brk)         (og_die_mem_brk);
+   VG_(track_die_mem_stack)       (og_die_mem_stack);
+   VG_(track_start_client_code)   (og_start_client_code);
+   VG_(track_pre_thread_ll_exit)  (og_pre_thread_ll_exit);
    VG_(details_avg_translation_sizeB) ( 275 );
 
    VG_(basic_tool_funcs)        (og_post_clo_init,
@@ -1194,7 +3506,7 @@ static void og_pre_clo_init(void)
                                  og_fini);
    OG_(register_error_handlers)();
 
-   init_auxmap_L1_L2();
+   init_radix();
 
    /* Build the 3 distinguished secondaries */
    sm = &sm_distinguished[SM_DIST_NOCHECK];
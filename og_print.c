@@ -0,0 +1,147 @@
+/*-------------------------------------------------------------------------*/
+/*--- og_print: show an objgrind shadow dump.                 og_print.c ---*/
+/*-------------------------------------------------------------------------*/
+
+/*
+   This file is part of Objgrind.
+
+   Copyright (C) 2013 Narihiro Nakamura
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* Usage: og_print [--state=unwritable|unreferable|refcheck]
+                   [--summary] <dump file>
+
+   Prints the runs in a dump written by --dump-shadow-at-exit,
+   VALGRIND_DUMP_SHADOW or the dump_shadow monitor command, one per
+   line, followed by the number of runs and bytes in each state.
+   Bytes not in any run are NOCHECK.  The file is mmap'd, so even a
+   dump of a huge heap is printed without being read in first. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "og_shadow_dump.h"
+
+static const char* const state_names[4] = {
+   "nocheck", "unwritable", "unreferable", "refcheck"
+};
+
+static void usage ( void )
+{
+   fprintf(stderr,
+      "usage: og_print [--state=unwritable|unreferable|refcheck] "
+      "[--summary] <dump file>\n");
+   exit(1);
+}
+
+static void barf ( const char* file, const char* msg )
+{
+   fprintf(stderr, "og_print: %s: %s\n", file, msg);
+   exit(1);
+}
+
+int main ( int argc, char** argv )
+{
+   const char*         file    = NULL;
+   int                 only    = -1;   /* print this state only */
+   int                 summary = 0;    /* totals only */
+   unsigned long long  n_runs[4]  = { 0 };
+   unsigned long long  n_bytes[4] = { 0 };
+   const OgDumpHeader* hdr;
+   const OgDumpRun*    runs;
+   struct stat         st;
+   void*               map;
+   unsigned long long  i;
+   int                 fd, k, s;
+
+   for (k = 1; k < argc; k++) {
+      const char* arg = argv[k];
+      if (strncmp(arg, "--state=", 8) == 0) {
+         for (s = 1; s < 4; s++)
+            if (strcmp(arg + 8, state_names[s]) == 0)
+               only = s;
+         if (only == -1)
+            usage();
+      } else if (strcmp(arg, "--summary") == 0) {
+         summary = 1;
+      } else if (arg[0] == '-' || file != NULL) {
+         usage();
+      } else {
+         file = arg;
+      }
+   }
+   if (file == NULL)
+      usage();
+
+   fd = open(file, O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) != 0) {
+      perror(file);
+      return 1;
+   }
+   if ((size_t)st.st_size < sizeof(OgDumpHeader))
+      barf(file, "too short to be a shadow dump");
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (map == MAP_FAILED) {
+      perror(file);
+      return 1;
+   }
+   close(fd);
+
+   hdr = map;
+   if (memcmp(hdr->magic, OG_DUMP_MAGIC, sizeof(hdr->magic)) != 0)
+      barf(file, "not a shadow dump");
+   if (hdr->byte_order != OG_DUMP_BYTE_ORDER)
+      barf(file, "written on a machine with a different byte order");
+   if (hdr->version != OG_DUMP_VERSION)
+      barf(file, "unknown dump version");
+   if (hdr->header_szB < sizeof(OgDumpHeader)
+       || hdr->header_szB > (unsigned long long)st.st_size
+       || hdr->n_runs > ((unsigned long long)st.st_size - hdr->header_szB)
+                        / sizeof(OgDumpRun))
+      barf(file, "truncated");
+
+   runs = (const OgDumpRun*)((const char*)map + hdr->header_szB);
+   for (i = 0; i < hdr->n_runs; i++) {
+      unsigned long long len   = OG_DUMP_RUN_LEN(&runs[i]);
+      unsigned int       state = OG_DUMP_RUN_STATE(&runs[i]);
+
+      n_runs[state]++;
+      n_bytes[state] += len;
+      if (summary || (only != -1 && (int)state != only))
+         continue;
+      printf("0x%llx-0x%llx %llu %s\n",
+             runs[i].start, runs[i].start + len, len, state_names[state]);
+   }
+
+   printf("%s%u-byte granules\n", summary ? "" : "\n", 1U << hdr->gran_shift);
+   for (s = 1; s < 4; s++) {
+      if (only != -1 && s != only)
+         continue;
+      printf("%-12s %llu runs, %llu bytes\n",
+             state_names[s], n_runs[s], n_bytes[s]);
+   }
+   munmap(map, st.st_size);
+   return 0;
+}
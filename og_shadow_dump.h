@@ -0,0 +1,44 @@
+
+/* Format of the shadow dumps written by objgrind (see
+   --dump-shadow-at-exit, VALGRIND_DUMP_SHADOW and the dump_shadow
+   monitor command) and read by og_print.  Included by both, so it
+   uses plain C types only.
+
+   A dump is an OgDumpHeader followed by n_runs OgDumpRuns in address
+   order, one per maximal run of bytes in the same state.  NOCHECK
+   runs aren't written: any byte not in a run is NOCHECK.  Everything
+   is in the byte order of the machine that wrote it (see byte_order)
+   and the records start header_szB bytes in, so a reader can mmap the
+   file and index the runs directly. */
+
+#ifndef __OG_SHADOW_DUMP_H
+#define __OG_SHADOW_DUMP_H
+
+#define OG_DUMP_MAGIC       "OGSHADOW"
+#define OG_DUMP_VERSION     1
+#define OG_DUMP_BYTE_ORDER  0x01020304
+
+typedef
+   struct {
+      char               magic[8];     // OG_DUMP_MAGIC, no terminating 0
+      unsigned int       version;      // OG_DUMP_VERSION
+      unsigned int       byte_order;   // OG_DUMP_BYTE_ORDER
+      unsigned int       header_szB;   // offset of the first run
+      unsigned int       gran_shift;   // log2 bytes per state
+      unsigned long long n_runs;
+   }
+   OgDumpHeader;
+
+/* len bytes from start, all in one state: UNWRITABLE (1), UNREFERABLE
+   (2) or REFCHECK (3). */
+typedef
+   struct {
+      unsigned long long start;
+      unsigned long long len_state;    // len << 2 | state
+   }
+   OgDumpRun;
+
+#define OG_DUMP_RUN_LEN(_r)    ((_r)->len_state >> 2)
+#define OG_DUMP_RUN_STATE(_r)  ((unsigned int)((_r)->len_state & 3))
+
+#endif
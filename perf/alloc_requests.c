@@ -0,0 +1,62 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A bump allocator that tells objgrind about every object: one
+   MAKE_OBJECT per allocation, a few frozen objects, and a whole-arena
+   MAKE_UNREFERABLE/MAKE_NOCHECK pair at each collection.  This is the
+   cost of the client request path rather than of the store helpers. */
+
+#define ARENA  (8 << 20)
+
+struct obj {
+	long header;
+	struct obj *car;
+	struct obj *cdr;
+	long klass;
+	long payload[2];
+};
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 40;
+	unsigned char refmap = (1 << 1) | (1 << 2);
+	unsigned char frozenmap = 1 << 3;
+	unsigned long type, made = 0, frozen = 0;
+	struct obj *arena, *prev = NULL;
+	size_t n_objs = ARENA / sizeof(struct obj), j;
+	int i;
+
+	arena = mmap(0, ARENA, PROT_READ|PROT_WRITE,
+		     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (arena == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	type = VALGRIND_REGISTER_OBJECT_LAYOUT(sizeof(struct obj),
+					       &refmap, &frozenmap);
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n_objs; j++) {
+			struct obj *o = &arena[j];
+
+			o->header = j;
+			o->klass = i;
+			made += VALGRIND_MAKE_OBJECT(o, type);
+			o->car = prev;
+			o->cdr = NULL;
+			o->payload[0] = o->payload[1] = 0;
+			if ((j & 15) == 0) {
+				VALGRIND_MAKE_UNWRITABLE(o, sizeof(*o));
+				frozen += VALGRIND_CHECK_UNWRITABLE(o);
+			}
+			prev = o;
+		}
+		/* Collect: everything is garbage. */
+		prev = NULL;
+		VALGRIND_MAKE_UNREFERABLE(arena, ARENA);
+		VALGRIND_MAKE_NOCHECK(arena, ARENA);
+	}
+	printf("%lu %lu\n", made, frozen);
+	return 0;
+}
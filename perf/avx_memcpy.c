@@ -0,0 +1,66 @@
+#include "../objgrind.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A copying collector's inner loop: big copies done with 256-bit
+   loads and stores, into a to-space with a REFCHECK field in every
+   other word.  Only copy32 is compiled for AVX, so without it (the
+   compiler can't target it, or the CPU doesn't have it) the program
+   still runs, with 128-bit vectors. */
+
+#define SIZE  (1 << 20)
+
+typedef long vec16 __attribute__((vector_size(16)));
+typedef long vec32 __attribute__((vector_size(32)));
+
+static void copy16(void *dst, const void *src, size_t len)
+{
+	vec16 *d = dst;
+	const vec16 *s = src;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(vec16); i++)
+		d[i] = s[i];
+}
+
+#if defined(WITH_AVX)
+__attribute__((target("avx")))
+static void copy32(void *dst, const void *src, size_t len)
+{
+	vec32 *d = dst;
+	const vec32 *s = src;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(vec32); i++)
+		d[i] = s[i];
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 2000;
+	void (*copy)(void *, const void *, size_t) = copy16;
+	long *from, *to;
+	unsigned long sum = 0;
+	int i;
+
+#if defined(WITH_AVX)
+	if (__builtin_cpu_supports("avx"))
+		copy = copy32;
+#endif
+	if (posix_memalign((void **)&from, 32, SIZE) != 0
+	    || posix_memalign((void **)&to, 32, SIZE) != 0) {
+		fprintf(stderr, "posix_memalign failed\n");
+		exit(1);
+	}
+	memset(from, 1, SIZE);
+	VALGRIND_ADD_REFCHECK_FIELDS(to, SIZE, 2 * sizeof(long));
+	for (i = 0; i < n; i++) {
+		from[i % (SIZE / sizeof(long))] = i;
+		copy(to, from, SIZE);
+		sum += to[i % (SIZE / sizeof(long))];
+	}
+	printf("%lu\n", sum);
+	return 0;
+}
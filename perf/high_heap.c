@@ -0,0 +1,71 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Heaps mapped far above 64GB, where memcheck-style primary maps stop
+   and shadow lookups take the slow path.  Stores are a mix of plain
+   words and REFCHECK fields.  If mmap won't put a heap where it is
+   asked to, the benchmark fails rather than measure something else.
+   On 32-bit platforms the heaps go wherever mmap puts them. */
+
+#define N_HEAPS    4
+#define HEAP_SIZE  (4 << 20)
+#define N_WORDS    (HEAP_SIZE / sizeof(long))
+
+static void *map_heap(int k)
+{
+	void *hint = NULL;
+	void *p;
+
+#if ULONG_MAX > 0xffffffffUL
+	/* 128GB, 2TB, 32TB, ... */
+	hint = (void *)(0x2000000000UL << (4 * k));
+	if ((unsigned long)hint >= 0x400000000000UL)
+		hint = (void *)(0x3000000000UL + (unsigned long)k * HEAP_SIZE);
+#endif
+	p = mmap(hint, HEAP_SIZE, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p == (void *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	/* The address is only a hint.  A heap placed elsewhere may be
+	   below 64GB, which would measure the path this is meant to
+	   avoid, so give up instead. */
+	if (hint != NULL && p != hint) {
+		fprintf(stderr, "high_heap: heap %d wanted at %p, got %p\n",
+			k, hint, p);
+		exit(1);
+	}
+	return p;
+}
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 100;
+	long *heaps[N_HEAPS];
+	unsigned long sum = 0;
+	size_t j;
+	int i, k;
+
+	for (k = 0; k < N_HEAPS; k++) {
+		heaps[k] = map_heap(k);
+		VALGRIND_ADD_REFCHECK_FIELDS(heaps[k], HEAP_SIZE,
+					     8 * sizeof(long));
+	}
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < N_HEAPS; k++) {
+			long *h = heaps[k];
+			long *other = heaps[(k + 1) % N_HEAPS];
+
+			for (j = 0; j < N_WORDS; j++)
+				h[j] = (j & 7) ? (long)j
+					       : (long)&other[j ^ 8];
+		}
+		sum += heaps[i % N_HEAPS][i + 1];
+	}
+	printf("%lu\n", sum);
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A collector that freezes and thaws whole spaces: large
+   MAKE_UNWRITABLE, MAKE_UNREFERABLE and MAKE_NOCHECK requests, some
+   of them with unaligned ends, with a store to every page in between
+   while the space is writable. */
+
+#define SPACE  (64 << 20)
+#define PAGE   4096
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 60;
+	char *space;
+	unsigned long sum = 0;
+	size_t off;
+	int i;
+
+	space = mmap(0, SPACE, PROT_READ|PROT_WRITE,
+		     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (space == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		VALGRIND_MAKE_UNWRITABLE(space, SPACE);
+		VALGRIND_MAKE_NOCHECK(space, SPACE);
+		for (off = 0; off < SPACE; off += PAGE)
+			space[off] = (char)i;
+		VALGRIND_MAKE_UNREFERABLE(space + 3, SPACE / 2 - 5);
+		VALGRIND_MAKE_UNWRITABLE(space + SPACE / 2 + 1, SPACE / 4);
+		VALGRIND_MAKE_NOCHECK(space, SPACE);
+		sum += space[(i * PAGE) % SPACE];
+	}
+	printf("%lu\n", sum);
+	return 0;
+}
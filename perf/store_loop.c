@@ -0,0 +1,33 @@
+#include "../objgrind.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Stores of every width to memory objgrind has never been told about.
+   Nearly all stores in a real program look like this, so this is the
+   cost of the fast path in the store helpers. */
+
+#define N_WORDS  (1 << 16)
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 4000;
+	long *buf = malloc(N_WORDS * sizeof(long));
+	unsigned long sum = 0;
+	int i, j;
+
+	if (buf == NULL) {
+		perror("malloc failed");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < N_WORDS; j++)
+			buf[j] = i + j;
+		for (j = 0; j < N_WORDS * 2; j += 3)
+			((int *)buf)[j] = i;
+		for (j = 0; j < N_WORDS * (int)sizeof(long); j += 7)
+			((char *)buf)[j] = (char)j;
+		sum += buf[i % N_WORDS];
+	}
+	printf("%lu\n", sum);
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The mutator side of a generational collector: pointer stores into
+   REFCHECK fields, each followed by a card-marking write barrier.
+   Every pointer store goes down the reference-checking slow path;
+   none of them is an error. */
+
+#define N_OBJS      (1 << 15)
+#define N_FIELDS    4
+#define CARD_SHIFT  9
+
+struct obj {
+	struct obj *field[N_FIELDS];
+	long data[N_FIELDS];
+};
+
+static struct obj *heap;
+static unsigned char cards[(N_OBJS * sizeof(struct obj)) >> CARD_SHIFT];
+
+static void write_field(struct obj *o, int k, struct obj *v)
+{
+	o->field[k] = v;
+	cards[((char *)o - (char *)heap) >> CARD_SHIFT] = 1;
+}
+
+static unsigned long scan_cards(void)
+{
+	unsigned long dirty = 0;
+	size_t i;
+
+	for (i = 0; i < sizeof(cards); i++) {
+		dirty += cards[i];
+		cards[i] = 0;
+	}
+	return dirty;
+}
+
+int main(int argc, char *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 400;
+	unsigned long seed = 1, dirty = 0;
+	int i, j, k;
+
+	heap = mmap(0, N_OBJS * sizeof(struct obj), PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (heap == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	for (k = 0; k < N_FIELDS; k++)
+		VALGRIND_ADD_REFCHECK_FIELDS(&heap[0].field[k],
+					     N_OBJS * sizeof(struct obj),
+					     sizeof(struct obj));
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < N_OBJS * 2; j++) {
+			seed = seed * 1103515245 + 12345;
+			write_field(&heap[(seed >> 8) % N_OBJS],
+				    (seed >> 4) % N_FIELDS,
+				    &heap[(seed >> 16) % N_OBJS]);
+			heap[j % N_OBJS].data[j % N_FIELDS] = j;
+		}
+		dirty += scan_cards();
+	}
+	printf("%lu\n", dirty);
+	return 0;
+}
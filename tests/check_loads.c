@@ -0,0 +1,37 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct obj {
+	long header;
+	struct obj *ref;
+};
+
+int main()
+{
+	int pgsz = getpagesize();
+	struct obj *objs, *dead, *p;
+	volatile struct obj *root;
+	long header;
+
+	objs = mmap(0, pgsz * 2, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (objs == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = (struct obj *)((char *)objs + pgsz);
+	root = &objs[0];
+
+	VALGRIND_ADD_REFCHECK_FIELD(&root->ref);
+	root->header = (long)dead;
+	root->ref = dead;            /* unreported: dead is still live */
+	VALGRIND_MAKE_UNREFERABLE(dead, sizeof(*dead));
+
+	header = root->header;       /* unreported: not a refcheck field */
+	p = root->ref;               /* error */
+	printf("%d %d\n", p == dead, header == (long)dead);
+	return 0;
+}
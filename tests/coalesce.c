@@ -0,0 +1,39 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct obj {
+	long header;
+	struct obj *ref;
+	long extra;
+};
+
+int main()
+{
+	struct obj *objs, *dead, init;
+
+	objs = mmap(0, sizeof(struct obj) * 4, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (objs == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = &objs[3];
+	VALGRIND_MAKE_UNREFERABLE(dead, sizeof(*dead));
+	VALGRIND_ADD_REFCHECK_FIELD(&objs[0].ref);
+	VALGRIND_MAKE_UNWRITABLE(&objs[1].header, sizeof(long));
+	VALGRIND_MAKE_UNWRITABLE(&objs[1].extra, sizeof(long));
+
+	/* Each copy is a run of stores off one base.  Checked as a
+	   group, the copy to objs[1] is one error; checked store by
+	   store (coalesce_off) it is one for each unwritable field. */
+	init.header = 1;
+	init.ref = dead;
+	init.extra = 2;
+	objs[0] = init;              /* error: ref */
+	init.ref = NULL;
+	objs[1] = init;              /* error: header and extra */
+	objs[2] = init;              /* unreported */
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SM_SIZE 65536
+
+int main()
+{
+	char *m, *area;
+
+	m = mmap(0, SM_SIZE * 3, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	area = (char *)(((size_t)m + SM_SIZE - 1) & ~(size_t)(SM_SIZE - 1));
+
+	/* A private secmap that is still in use is kept. */
+	VALGRIND_ADD_REFCHECK_FIELD(area + 8);
+	VALGRIND_MAKE_UNWRITABLE(area + SM_SIZE + 16, 64);
+	printf("in use: %lu\n", (unsigned long)VALGRIND_COMPACT_SHADOW());
+
+	/* Once every byte is back to one state, it is reclaimed. */
+	VALGRIND_REMOVE_REFCHECK_FIELD(area + 8);
+	printf("refcheck removed: %lu\n",
+	       (unsigned long)VALGRIND_COMPACT_SHADOW());
+
+	VALGRIND_MAKE_UNWRITABLE(area + SM_SIZE, SM_SIZE - 8);
+	VALGRIND_MAKE_UNWRITABLE(area + SM_SIZE * 2 - 8, 8);
+	printf("all unwritable: %lu\n",
+	       (unsigned long)VALGRIND_COMPACT_SHADOW());
+	printf("still unwritable: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(area + SM_SIZE + 100));
+
+	VALGRIND_MAKE_NOCHECK(area, SM_SIZE * 2);
+	printf("again: %lu\n", (unsigned long)VALGRIND_COMPACT_SHADOW());
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct obj {
+	struct obj *car;
+	struct obj *cdr;
+};
+
+int main()
+{
+	struct obj *heap = mmap(0, 4096, PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	struct obj *root, *other, *ref;
+	char *unaligned;
+
+	if (heap == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	root = &heap[0];
+	other = &heap[1];
+	VALGRIND_ADD_REFCHECK_FIELD(&root->car);
+	VALGRIND_ADD_REFCHECK_FIELD(&root->cdr);
+	VALGRIND_ADD_REFCHECK_FIELD(&other->car);
+	VALGRIND_ADD_REFCHECK_FIELD(&other->cdr);
+	root->car = other;
+	root->cdr = &heap[2];
+	other->car = &heap[2];
+	other->cdr = &heap[3];
+
+	printf("before: %d\n", (int)VALGRIND_CHECK_DANGLING_REFS());
+	/* The collector frees heap[2] and heap[3] but misses the three
+	   pointers to them; each is reported. */
+	VALGRIND_MAKE_UNREFERABLE(&heap[2], 2 * sizeof(struct obj));
+	printf("after: %d\n", (int)VALGRIND_CHECK_DANGLING_REFS()); /* 3 errors */
+	root->cdr = NULL;
+	other->car = NULL;
+	other->cdr = NULL;
+	printf("fixed: %d\n", (int)VALGRIND_CHECK_DANGLING_REFS());
+
+	/* A field needn't be word aligned. */
+	unaligned = (char *)&heap[4] + 1;
+	ref = &heap[2];
+	memcpy(unaligned, &ref, sizeof(ref));
+	VALGRIND_ADD_REFCHECK_FIELD(unaligned);
+	printf("unaligned: %d\n", (int)VALGRIND_CHECK_DANGLING_REFS()); /* error */
+	return 0;
+}
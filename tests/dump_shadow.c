@@ -0,0 +1,27 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The dump is checked by running og_print --summary on it (see the
+   .vgtest), since the addresses vary. */
+
+int main()
+{
+	char *m;
+
+	m = mmap(0, 8192, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(m, 1000);
+	VALGRIND_MAKE_UNREFERABLE(m + 1003, 100);
+	/* A fixed stride, so the dump is the same on 32-bit. */
+	VALGRIND_ADD_REFCHECK_FIELDS(m + 2048, 64, 8);
+	printf("dumped: %d\n", (int)VALGRIND_DUMP_SHADOW("dump_shadow.out"));
+	printf("bad file: %d\n",
+	       (int)VALGRIND_DUMP_SHADOW("no/such/dir/dump_shadow.out"));
+	return 0;
+}
@@ -0,0 +1,25 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Errors from one code address are recorded once and then counted. */
+int main()
+{
+	int pgsz = getpagesize();
+	char *buf;
+	int i;
+
+	buf = mmap(0, pgsz, PROT_READ|PROT_WRITE,
+		   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(buf, pgsz);
+
+	for (i = 0; i < 100; i++)
+		buf[i * 8] = 1;   /* 1 error, 99 counted */
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SM_SIZE 65536
+
+int main()
+{
+	char *m, *area;
+	unsigned long freed;
+
+	m = mmap(0, SM_SIZE * 2, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	area = (char *)(((size_t)m + SM_SIZE - 1) & ~(size_t)(SM_SIZE - 1));
+
+	/* Ranges are rounded out to whole words. */
+	VALGRIND_MAKE_UNWRITABLE(area + sizeof(void *) + 1, 2);
+	printf("word before: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(area + sizeof(void *) - 1));
+	printf("first byte: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(area + sizeof(void *)));
+	printf("last byte: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(area + sizeof(void *) * 2 - 1));
+	printf("word after: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(area + sizeof(void *) * 2));
+
+	area[sizeof(void *) + 5] = 'x';     /* error */
+	area[sizeof(void *) * 2] = 'x';     /* unreported */
+
+	/* Secmaps are a word size fraction of the byte granularity ones. */
+	VALGRIND_MAKE_NOCHECK(area, 64);
+	freed = VALGRIND_COMPACT_SHADOW();
+	printf("secmap size ok: %d\n", freed * sizeof(void *) == 16384);
+	return 0;
+}
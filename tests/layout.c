@@ -0,0 +1,44 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct obj {
+	long header;
+	struct obj *car;
+	struct obj *cdr;
+	long klass;     /* frozen */
+};
+
+int main()
+{
+	int pgsz = getpagesize();
+	unsigned char refmap = (1 << 1) | (1 << 2);
+	unsigned char frozenmap = 1 << 3;
+	struct obj *objs, *dead;
+	unsigned long type;
+
+	objs = mmap(0, pgsz * 2, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (objs == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = (struct obj *)((char *)objs + pgsz);
+	VALGRIND_MAKE_UNREFERABLE(dead, sizeof(*dead));
+
+	type = VALGRIND_REGISTER_OBJECT_LAYOUT(sizeof(struct obj),
+					       &refmap, &frozenmap);
+	printf("type registered: %d\n", type != 0);
+	printf("made: %d\n", (int)VALGRIND_MAKE_OBJECT(&objs[0], type));
+	printf("made: %d\n", (int)VALGRIND_MAKE_OBJECT(&objs[1], type));
+	printf("bad type: %d\n", (int)VALGRIND_MAKE_OBJECT(&objs[2], 9999));
+
+	objs[1].header = (long)dead;   /* unreported */
+	objs[1].cdr = objs;            /* unreported */
+	objs[1].cdr = dead;            /* error */
+	objs[0].klass = 0;             /* error */
+	objs[2].klass = 0;             /* unreported */
+	return 0;
+}
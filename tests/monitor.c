@@ -0,0 +1,38 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Monitor commands run through VALGRIND_MONITOR_COMMAND print to the
+   log when no gdb is attached. */
+
+static void monitor(const char *cmd, char *m, unsigned long len)
+{
+	char buf[100];
+
+	if (len)
+		sprintf(buf, "%s %p %lu", cmd, m, len);
+	else
+		sprintf(buf, "%s %p", cmd, m);
+	VALGRIND_MONITOR_COMMAND(buf);
+}
+
+int main()
+{
+	char *m = mmap(0, 8192, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(m, 100);
+	/* A fixed stride, so the output is the same on 32-bit. */
+	VALGRIND_ADD_REFCHECK_FIELDS(m + 128, 64, 8);
+	VALGRIND_MAKE_UNREFERABLE(m + 4096, 4096);
+
+	monitor("state", m, 256);
+	monitor("state", m, 0);
+	monitor("summary", m, 8192);
+	monitor("summary", m, 0);
+	return 0;
+}
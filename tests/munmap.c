@@ -0,0 +1,43 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static char *mm(char *addr, int size)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	char *ret;
+
+	if (addr)
+		flags |= MAP_FIXED;
+
+	ret = mmap(addr, size, PROT_READ|PROT_WRITE, flags, -1, 0);
+	if (ret == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	return ret;
+}
+
+int main()
+{
+	int pgsz = getpagesize();
+	char *m = mm(0, pgsz * 4);
+	char **field = (char **)(m + pgsz * 2);
+
+	VALGRIND_MAKE_UNWRITABLE(m, pgsz);
+	VALGRIND_MAKE_UNREFERABLE(m + pgsz, pgsz);
+	VALGRIND_ADD_REFCHECK_FIELD(field);
+	munmap(m, pgsz * 4);
+
+	/* Reuse the same addresses; nothing about the old mapping may
+	   survive. */
+	mm(m, pgsz * 4);
+	printf("unwritable after remap: %d\n",
+	       (int)VALGRIND_CHECK_UNWRITABLE(m));
+	m[0] = 'x';            /* unreported */
+	*field = m + pgsz;     /* unreported */
+	printf("done\n");
+	return 0;
+}
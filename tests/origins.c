@@ -0,0 +1,37 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct obj {
+	long header;
+	struct obj *ref;
+};
+
+static void sweep(struct obj *o)
+{
+	VALGRIND_MAKE_UNREFERABLE(o, sizeof(*o));
+}
+
+int main()
+{
+	struct obj *heap, *root;
+
+	heap = mmap(0, sizeof(struct obj) * 8, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (heap == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	root = &heap[0];
+	VALGRIND_ADD_REFCHECK_FIELD(&root->ref);
+
+	/* sweep() cuts heap[4] out of the range made unreferable here. */
+	VALGRIND_MAKE_UNREFERABLE(&heap[2], sizeof(struct obj) * 4);
+	sweep(&heap[4]);
+
+	root->ref = (struct obj *)&heap[4].ref;   /* error, from sweep */
+	root->ref = &heap[3];                     /* error, from main */
+	root->ref = &heap[5];                     /* error, from main */
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+	unsigned char bitmap[4];
+	char *m = mmap(0, 8192, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	char *ro = mmap(0, 4096, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	long *obj;
+	int i;
+
+	if (m == (char *)-1 || ro == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	obj = (long *)(m + 4096);
+	VALGRIND_MAKE_UNWRITABLE(m + 100, 50);
+	VALGRIND_MAKE_UNREFERABLE(m + 1000, 24);
+	VALGRIND_ADD_REFCHECK_FIELD(&obj[1]);
+	VALGRIND_ADD_REFCHECK_FIELD(&obj[4]);
+
+	printf("unwritable: %d\n",
+	       (int)VALGRIND_COUNT_STATE(m, 4096, VALGRIND_STATE_UNWRITABLE));
+	printf("unreferable: %d\n",
+	       (int)VALGRIND_COUNT_STATE(m, 4096, VALGRIND_STATE_UNREFERABLE));
+	printf("nocheck: %d\n",
+	       (int)VALGRIND_COUNT_STATE(m, 4096, VALGRIND_STATE_NOCHECK));
+	printf("first unreferable: %ld\n",
+	       (long)VALGRIND_FIND_STATE(m, 4096, VALGRIND_STATE_UNREFERABLE));
+	printf("first unreferable after it: %ld\n",
+	       (long)VALGRIND_FIND_STATE(m + 1024, 4096,
+					 VALGRIND_STATE_UNREFERABLE));
+
+	printf("words: %d\n",
+	       (int)VALGRIND_GET_STATE_BITMAP(obj, 6 * sizeof(long), bitmap));
+	for (i = 0; i < 6; i++)
+		printf("obj[%d]: %d\n", i, (bitmap[i / 4] >> (i % 4 * 2)) & 3);
+	printf("unaligned: %d\n",
+	       (int)VALGRIND_GET_STATE_BITMAP(m + 1, 64, bitmap));
+	printf("read-only bitmap: %d\n",
+	       (int)VALGRIND_GET_STATE_BITMAP(obj, 6 * sizeof(long), ro));
+	return 0;
+}
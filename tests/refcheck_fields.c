@@ -0,0 +1,51 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct obj {
+	long header;
+	struct obj *ref;
+};
+
+int main()
+{
+	int pgsz = getpagesize();
+	struct obj *objs, *dead;
+	void **scattered[3];
+	int i;
+
+	objs = mmap(0, pgsz * 2, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (objs == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = (struct obj *)((char *)objs + pgsz);
+	VALGRIND_MAKE_UNREFERABLE(dead, sizeof(*dead));
+
+	/* Every .ref of an array of 16 objects. */
+	printf("strided: %lu\n",
+	       (unsigned long)VALGRIND_ADD_REFCHECK_FIELDS(
+		       &objs[0].ref, sizeof(struct obj) * 16,
+		       sizeof(struct obj)));
+	objs[3].header = (long)dead;   /* unreported */
+	objs[3].ref = dead;            /* error */
+	printf("removed: %lu\n",
+	       (unsigned long)VALGRIND_REMOVE_REFCHECK_FIELDS(
+		       &objs[0].ref, sizeof(struct obj) * 16,
+		       sizeof(struct obj)));
+	objs[3].ref = dead;            /* unreported */
+
+	/* Scattered fields passed by pointer. */
+	for (i = 0; i < 3; i++)
+		scattered[i] = (void **)&objs[20 + i * 5].ref;
+	printf("array: %lu\n",
+	       (unsigned long)VALGRIND_ADD_REFCHECK_FIELD_ARRAY(scattered, 3));
+	objs[25].ref = dead;           /* error */
+	objs[26].ref = dead;           /* unreported */
+	VALGRIND_REMOVE_REFCHECK_FIELD_ARRAY(scattered, 3);
+	objs[25].ref = dead;           /* unreported */
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Exercise the word and secmap sized steps of set_address_range_perms
+   and check the result byte by byte against a simple model of the
+   byte-at-a-time behaviour. */
+
+#define SM_SIZE  65536
+#define N_SM     4
+#define AREA     (SM_SIZE * N_SM)
+
+static char *area;
+static char model[AREA];
+
+static void make(int unwritable, size_t off, size_t len)
+{
+	if (unwritable)
+		VALGRIND_MAKE_UNWRITABLE(area + off, len);
+	else
+		VALGRIND_MAKE_NOCHECK(area + off, len);
+	memset(model + off, unwritable, len);
+}
+
+static int check(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < AREA; i++) {
+		if (VALGRIND_CHECK_UNWRITABLE(area + i) != model[i]) {
+			printf("%s: mismatch at offset %lu\n",
+			       name, (unsigned long)i);
+			return 0;
+		}
+	}
+	printf("%s: PASS\n", name);
+	return 1;
+}
+
+int main()
+{
+	char *m;
+
+	m = mmap(0, AREA + SM_SIZE, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	/* Align to a secmap boundary so whole secmaps get covered. */
+	area = (char *)(((size_t)m + SM_SIZE - 1) & ~(size_t)(SM_SIZE - 1));
+
+	/* Within one secmap, unaligned at both ends. */
+	make(1, 3, 29);
+	check("small unaligned");
+
+	/* Partial first secmap, one whole secmap, partial last. */
+	make(1, SM_SIZE - 5, SM_SIZE + 13);
+	check("spanning secmaps");
+
+	/* Whole secmaps, then punch holes back into them. */
+	make(1, 0, AREA);
+	make(0, 7, 1);
+	make(0, SM_SIZE * 2 + 1, 17);
+	check("whole then holes");
+
+	/* Reset everything; whole secmaps go back to NOCHECK. */
+	make(0, 0, AREA);
+	check("reset");
+
+	/* Length not a multiple of 8 ending exactly on a secmap. */
+	make(1, SM_SIZE + 9, SM_SIZE * 2 - 9);
+	check("ends on boundary");
+
+	make(0, 0, AREA);
+	return 0;
+}
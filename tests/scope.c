@@ -0,0 +1,44 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct obj {
+	long header;
+	struct obj *ref;
+};
+
+static struct obj *objs, *dead;
+
+__attribute__((noinline)) static void gc_mark(struct obj *o)
+{
+	o->header |= 1;              /* unreported: collector */
+	o->ref = dead;               /* error: refs are still checked */
+}
+
+__attribute__((noinline)) static void ignored_write(struct obj *o)
+{
+	o->header = 0;               /* unreported: not instrumented */
+	o->ref = dead;               /* unreported: not instrumented */
+}
+
+int main()
+{
+	objs = mmap(0, sizeof(struct obj) * 4, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (objs == (struct obj *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = &objs[3];
+	VALGRIND_MAKE_UNREFERABLE(dead, sizeof(*dead));
+	VALGRIND_ADD_REFCHECK_FIELD(&objs[0].ref);
+	VALGRIND_MAKE_UNWRITABLE(&objs[1], sizeof(struct obj));
+
+	gc_mark(&objs[0]);
+	gc_mark(&objs[1]);
+	ignored_write(&objs[0]);
+	ignored_write(&objs[1]);
+	objs[1].header = 0;          /* error */
+	return 0;
+}
@@ -0,0 +1,29 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+	char *heap = mmap(0, 4096, PROT_READ|PROT_WRITE,
+			  MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (heap == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(heap, 4096);
+
+#if defined(__x86_64__)
+	{
+		/* A slot in the red zone below the stack pointer, written
+		   through %rsp: only reported in stack_stores_off. */
+		unsigned long slot;
+		__asm__ __volatile__("leaq -64(%%rsp), %0" : "=r"(slot));
+		VALGRIND_MAKE_UNWRITABLE(slot, 8);
+		__asm__ __volatile__("movq $1, -64(%%rsp)" ::: "memory");
+		VALGRIND_MAKE_NOCHECK(slot, 8);
+	}
+#endif
+	heap[0] = 1;                 /* error */
+	return 0;
+}
@@ -0,0 +1,31 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void write_frozen(volatile char *p)
+{
+	p[0] = 'x';
+}
+
+int main()
+{
+	char *m = mmap(0, 4096, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(m, 4096);
+
+	VALGRIND_STOP_CHECKING();
+	write_frozen(m);             /* unreported: checking is off */
+	VALGRIND_START_CHECKING();
+	write_frozen(m + 1);         /* error */
+
+	VALGRIND_DISABLE_THREAD_CHECKING();
+	write_frozen(m + 2);         /* unreported: off for this thread */
+	VALGRIND_ENABLE_THREAD_CHECKING();
+	write_frozen(m + 3);         /* error */
+	return 0;
+}
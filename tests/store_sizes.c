@@ -0,0 +1,28 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Stores of every size are checked across all the bytes they write,
+   not just the first one. */
+int main()
+{
+	char *buf;
+
+	buf = mmap(0, getpagesize(), PROT_READ|PROT_WRITE,
+		   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	VALGRIND_MAKE_UNWRITABLE(buf + 5, 1);
+
+	*(volatile char *)(buf + 4) = 1;    /* unreported */
+	*(volatile short *)(buf + 4) = 1;   /* error */
+	*(volatile int *)(buf + 2) = 1;     /* error */
+	*(volatile long long *)buf = 1;     /* error */
+	*(volatile long long *)(buf + 8) = 1; /* unreported */
+	*(volatile char *)(buf + 6) = 1;    /* unreported */
+	return 0;
+}
@@ -0,0 +1,21 @@
+#include "../objgrind.h"
+#include <stdio.h>
+
+/* An unwritable store is reported at the first unwritable byte it
+   writes, which needn't be its first byte: the offsets into buf show
+   which byte was named. */
+typedef long vec __attribute__((vector_size(16)));
+
+char buf[64] __attribute__((aligned(16)));
+
+int main()
+{
+	vec v = { 0, 0 };
+
+	VALGRIND_MAKE_UNWRITABLE(buf + 5, 1);
+	VALGRIND_MAKE_UNWRITABLE(buf + 45, 1);
+	*(volatile short *)(buf + 4) = 1;    /* error: buf + 5 */
+	*(volatile long long *)buf = 1;      /* error: buf + 5 */
+	*(volatile vec *)(buf + 32) = v;     /* error: buf + 45 */
+	return 0;
+}
@@ -0,0 +1,35 @@
+#include "../objgrind.h"
+#include "tests/sys_mman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* 16-byte stores are checked as a whole; reference checks still look
+   at each word. */
+typedef long vec __attribute__((vector_size(16)));
+
+int main()
+{
+	int pgsz = getpagesize();
+	char *buf, *dead;
+	vec v;
+
+	buf = mmap(0, pgsz * 2, PROT_READ|PROT_WRITE,
+		   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (buf == (char *)-1) {
+		perror("mmap failed");
+		exit(1);
+	}
+	dead = buf + pgsz;
+	VALGRIND_MAKE_UNREFERABLE(dead, 16);
+
+	v[0] = 0;
+	v[1] = (long)dead;
+	*(volatile vec *)buf = v;            /* unreported */
+	VALGRIND_ADD_REFCHECK_FIELD(buf + sizeof(long));
+	*(volatile vec *)buf = v;            /* error */
+	*(volatile vec *)(buf + 32) = v;     /* unreported */
+	VALGRIND_MAKE_UNWRITABLE(buf + 47, 1);
+	*(volatile vec *)(buf + 32) = v;     /* error */
+	return 0;
+}